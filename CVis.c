@@ -5,126 +5,354 @@
 #include <math.h>
 #include <ctype.h>
 #include <float.h>
+#include <pthread.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 #include <GL/freeglut.h>
+#include <GL/glext.h>
 
-#define DEBUG FALSE
+#define DEBUG false
+
+// Inputs smaller than this are parsed on the calling thread
+#define PARALLEL_PARSE_MIN_BYTES (1 << 20)
+
+// Input parsed between two progress reports of a progressive load
+#define LOAD_BATCH_BYTES ((size_t)32 << 20)
+
+// Byte alignment of every column array, one cache line
+#define COLUMN_ALIGNMENT 64
+
+// Line segments submitted per glDrawElements call
+#define SEGMENTS_PER_DRAW (1 << 20)
+
+// Bounds on the cells per side of the (left value, right value) grid of each
+// axis gap; the grid is sized so a cell holds a handful of segments
+#define PICK_GRID_MIN 64
+#define PICK_GRID_MAX 1024
+
+// Aggregated rendering: largest bins per axis, memory cap for the per-class
+// histograms, and the row count above which the mode is enabled at startup
+#define AGGREGATE_MAX_BINS 64
+#define AGGREGATE_BUDGET_BYTES (256u << 20)
+#define AGGREGATE_AUTO_ROWS 5000000
+
+// Compact storage keeps normalized values as 16-bit fixed point in [0, QUANT_MAX],
+// with QUANT_NAN marking missing values, and densities as 8-bit levels
+#define QUANT_MAX 65534
+#define QUANT_NAN 0xFFFF
+
+// Rows dequantized at a time by the block accessors
+#define COLUMN_BLOCK_ROWS 4096
+
+// Records sampled from the start of a CSV to tell categorical columns from
+// numeric ones, and most categories labeled on an axis
+#define TYPE_SAMPLE_ROWS 1000
+#define MAX_CATEGORY_LABELS 40
+
+// Follow mode polls the input this often, and polyline buffer objects keep
+// room for at least this many appended rows
+#define FOLLOW_INTERVAL_MS 500
+#define FOLLOW_MIN_HEADROOM 65536
+
+// In the GUI, polylines accumulate in the static layer over frames, one slice
+// of about SLICE_BUDGET_MS of drawing per frame. From SAMPLE_MIN_ROWS rows on
+// they are drawn in a stratified sample order, so every partial layer shows a
+// sample in which each class keeps at least SAMPLE_MIN_PER_CLASS rows.
+#define SLICE_BUDGET_MS 30.0
+#define SAMPLE_MIN_ROWS 1000000
+#define SAMPLE_MIN_PER_CLASS 1000
+
+// Out-of-core datasets (--out-of-core) are stored in tiles of TILE_ROWS rows,
+// and their densities come from per-column histograms of DENSITY_PROFILE_BINS bins
+#define TILE_ROWS 65536
+#define DENSITY_PROFILE_BINS 65536
 
 typedef struct {
     char* class_name;
     float r, g, b;
 } ClassInfo;
 
-float** global_data = NULL;
+// Fixed-size block of interned strings
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+// Label dictionary: an open-addressing hash table over ClassInfo entries kept
+// in first-seen order, with the label strings interned into an arena
+typedef struct {
+    ClassInfo* class_info;
+    uint32_t* hashes;      // Hash of every entry, reused when the table grows
+    int num_classes;
+    int capacity;          // Entries allocated in class_info and hashes
+    int* slots;            // Entry index + 1, 0 marks an empty slot
+    int num_slots;         // Power of two
+    ArenaBlock* arena;
+} ClassDict;
+
+// Memory mapping of a whole file, read-only or private copy-on-write
+typedef struct {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} MappedFile;
+
+// Running statistics of a column's raw values, gathered while parsing so
+// normalizing needs no pass of its own. NaN values are left out.
+typedef struct {
+    float min, max;
+    double sum, sum_sq;
+    size_t count;
+} ColumnStats;
+
+// Affine map from a column's raw values to the drawn ones, (value - shift) * scale + offset
+typedef struct {
+    float shift, scale, offset;
+} ColumnMap;
+
+// Cached chunk of the tile file: one column of one tile
+typedef struct {
+    int chunk;             // tile * cols + col held, -1 while free
+    float* values;         // TILE_ROWS values, normalized as they were read
+    unsigned long long last_used;
+} TilePage;
+
+// Out-of-core rows: a scratch file next to the CSV holds tiles of TILE_ROWS
+// rows, each tile one chunk per column with class ids in the class column's
+// chunk. Chunks are read back into at most num_pages pages, the least
+// recently used page making room for the next miss.
+typedef struct {
+    char* path;
+    FILE* file;
+    int cols, class_col_index;
+    int rows;              // Rows written, all tiles but the last are full
+    int* chunk_pages;      // Page of every chunk written, -1 when not cached
+    TilePage* pages;
+    int num_pages;
+    unsigned long long clock;
+    unsigned long long chunks_read; // Page misses
+    const ColumnMap* maps; // Applied to value chunks as they are read, NULL while loading
+    uint32_t* profile;     // [col][DENSITY_PROFILE_BINS + 1] cumulative value histograms, see profile_density
+    float* profile_scale;  // Per column alpha scale of the profile densities at brush_size
+    pthread_mutex_t lock;
+} TileStore;
+
+// Column-oriented dataset: one aligned array per attribute plus the class ids
+typedef struct {
+    int rows;
+    int cols;
+    int class_col_index;
+    size_t capacity;  // Rows allocated in every array
+    float** columns;  // columns[col][row], NULL for the class column and in compact mode
+    int* class_ids;   // class_ids[row]
+    int** sorted_rows; // sorted_rows[col][k] is the row with the k-th smallest value, built lazily
+    MappedFile* mapping; // Cache file the arrays below were mapped from, NULL when none
+    bool arrays_mapped;  // columns and class_ids point into mapping instead of being owned
+    uint16_t** quantized; // Compact mode: quantized[col][row] replaces columns, see dataset_value
+    ColumnStats* stats;   // stats[col] of the values as parsed, NULL when loaded normalized
+    ColumnMap* maps;      // Maps normalize_data applied, NULL before normalizing or when loaded normalized
+    TileStore* tiles;     // Out-of-core rows instead of columns and class_ids, see column_block and class_block
+    bool* categorical;    // categorical[col] when the column holds category codes, NULL when none does
+    ClassDict* categories; // categories[col] interns a categorical column's values, codes in first-seen order
+} Dataset;
+
+// Polyline geometry for the parallel coordinates view, kept on the GPU when
+// vertex buffer objects are available and in client memory otherwise
+typedef struct {
+    int rows;
+    int axes;              // Visible axes, i.e. vertices per polyline
+    float* vertices;       // x, y per vertex before the stretch transform
+    GLubyte* colors;       // RGBA per vertex, alpha carries the density
+    GLuint* indices;       // GL_LINES pairs, (axes - 1) segments per polyline
+    size_t num_indices;
+    GLuint vertex_vbo, color_vbo, index_vbo;
+    int capacity_rows;     // Polylines the buffer objects have room for
+    float* density_scale;  // Per column alpha scale of the last full build, reused by appends
+    uint64_t* missing;     // Bit per vertex whose value is missing (NaN)
+    bool dirty;            // Data, densities or axis inversion changed
+} PolylineBuffers;
+
+// Segments between two neighboring axes, bucketed by the cell of their
+// (left value, right value) pair. Entries are stored grouped by cell with
+// their displayed endpoint heights, so a query reads memory sequentially.
+typedef struct {
+    int left_col, right_col;
+    int* cell_start;       // grid * grid + 1 offsets into the entries
+    int* cell_rows;        // Row of every entry
+    float* cell_values;    // Left and right height of every entry, inversion applied
+    uint16_t* cell_levels; // The same heights quantized, used instead in compact mode
+} GapIndex;
+
+// Hover picking index over every axis gap, rebuilt lazily
+typedef struct {
+    int num_gaps;
+    GapIndex* gaps;
+    int grid;              // Cells per side
+    bool dirty;            // Data or axis inversion changed
+} PickIndex;
+
+// Rows matched by a brush: one bit per row plus the matches per class
+typedef struct {
+    int rows;
+    uint64_t* bits;        // (rows + 63) / 64 words
+    int* class_counts;
+    int num_classes;
+    int selected;
+} Selection;
+
+// Brushes fold into one selection in order: the first starts it, then OR adds
+// a brush's rows, AND keeps only its rows and NOT removes them
+enum { BRUSH_OR, BRUSH_AND, BRUSH_NOT };
+#define MAX_BRUSHES 8
+
+typedef struct {
+    float x0, y0, x1, y1;  // Box in unstretched world coordinates, x0 <= x1 and y0 <= y1
+    int op;
+    Selection rows;        // Rows whose polyline crosses the box; class counts are left stale
+} Brush;
+
+// Segment indices of the selected polylines in draw order. While brushes
+// exist the static layer draws all polylines dimmed, then these in color.
+typedef struct {
+    GLuint* indices;
+    size_t num_segments;
+    bool dirty;            // The selection changed
+} FocusBatch;
+
+// Aggregated view of the parallel coordinates: for every pair of neighboring
+// axes, a per-class 2D histogram of (left value, right value) over raw
+// normalized values, drawn as shaded bands between the axes
+typedef struct {
+    int num_gaps;
+    int* gap_cols;         // Left and right column of every gap
+    int bins;
+    int num_classes;
+    uint32_t* counts;      // [gap][class][left bin][right bin]
+    int binned_rows;       // Rows already added, so appends bin incrementally
+    float* band_vertices;  // Four unstretched vertices per non-empty bin
+    GLubyte* band_colors;
+    size_t num_bands;
+    bool geometry_dirty;   // Histograms, colors or axis inversion changed
+} AggregateView;
+
+// The parallel coordinates view without its overlay (hover highlight, bounding
+// box), captured into a texture after a full draw. Until the view changes,
+// frames only composite the texture and redraw the overlay.
+typedef struct {
+    GLuint texture;
+    int texture_width, texture_height; // Power-of-two size of the texture
+    int width, height;                 // Size of the captured frame
+    float translate_x, translate_y, scale, stretch_x, stretch_y;
+    bool aggregate;
+    bool valid;
+    bool dirty;                        // Data, densities or axis inversion changed
+    size_t segments_drawn;             // Polyline segments accumulated so far
+    size_t segments_total;             // Segments of the complete layer
+    bool context;                      // Polylines dimmed as context for a brushed selection
+    size_t context_segments;           // Segments of all polylines; the brushed ones follow them
+    GLuint context_texture;            // Copy of the layer taken when the context was complete
+    bool context_saved;
+    bool focus_dirty;                  // The selection changed, redraw the brushed polylines
+} StaticLayer;
+
+// Column normalizations: per-column range, z-scores on a common scale, or one range for all axes
+typedef enum { NORMALIZE_MINMAX, NORMALIZE_ZSCORE, NORMALIZE_GLOBAL } Normalization;
+
+Dataset* global_data = NULL;
 int global_rows = 0, global_cols = 0, global_class_col_index = 0;
 float translate_x = 0.0f, translate_y = 0.0f, stretch_factor_x = 1.0f, stretch_factor_y = 1.0f;
 float scale = 1.0f;
 bool* axis_inverted = NULL;
 
-ClassInfo* class_info = NULL;
+ClassDict class_dict;
+ClassInfo* class_info = NULL; // Views of class_dict, refreshed after loading
 int num_classes = 0;
 
 int closest_axis1 = -1;
 int closest_axis2 = -1;
 
-// Global variables for bounding box
-bool drawing_box = false;
-bool box_drawn = false;
-float box_start_x, box_start_y;
-float box_end_x, box_end_y;
+// Brushes, the last one following the cursor while dragging_brush
+Brush brushes[MAX_BRUSHES];
+int num_brushes = 0;
+bool dragging_brush = false;
+float drag_start_x, drag_start_y;
 
 int scatter_plot_window;
 int parallel_coords_window;
 
 int hovered_row = -1;
 float* density = NULL;
-
-// Function to draw the bounding box
-void draw_bounding_box() {
-    if (drawing_box || box_drawn) {
-        glColor3f(1.0f, 0.0f, 0.0f); // Red color for the bounding box
-        glLineWidth(1.0f);
+uint8_t* density_levels = NULL; // Compact mode densities, used when density is NULL
+bool compact_mode = false; // Quantize values and densities after loading
+bool out_of_core = false; // Keep the rows in a tile file read through a bounded page cache
+size_t memory_budget = (size_t)1024 << 20; // Bytes the out-of-core page cache may hold
+
+PolylineBuffers pc_buffers = { .dirty = true };
+PickIndex pick_index = { .dirty = true };
+Selection box_selection; // Rows selected by all brushes combined
+FocusBatch focus_batch = { .dirty = true };
+AggregateView aggregate_view;
+bool aggregate_mode = false; // Draw density bands instead of polylines
+Normalization normalization = NORMALIZE_MINMAX; // How normalize_data maps columns into [0, 1]
+bool splom_mode = false; // Scatter window shows all axis pairs instead of the hovered one
+bool hud_visible = false; // Performance overlay in the parallel coordinates window
+bool loading = false; // A background load is running, the views show its latest preview
+bool following = false; // --follow: rows appended to the input are loaded as they arrive
+int* sample_order = NULL; // Stratified draw order of the first sample_order_rows rows, NULL draws in file order
+int sample_order_rows = 0;
+int drawn_rows = 0; // Polylines in the static layer so far, fewer than global_rows while it accumulates
+double segments_per_ms = 2000.0; // Measured polyline throughput, sizes the slices
+float load_fraction = 0.0f; // Share of the input parsed so far
+int load_rows = 0;
+StaticLayer static_layer = { .dirty = true };
+
+// Offscreen rendering without GLUT windows (--render)
+bool headless = false;
+int headless_width = 1600, headless_height = 1200;
+
+// Distance within which values on an axis count towards each other's density
+float brush_size = 0.01f;
+
+// Draws the brush boxes: red adds rows, blue intersects, black removes
+void draw_brushes() {
+    glLineWidth(1.0f);
+    glPushMatrix();
+    glScalef(stretch_factor_x, stretch_factor_y, 1.0f); // Box corners are unstretched world coordinates
+    for (int b = 0; b < num_brushes; b++) {
+        Brush* brush = &brushes[b];
+        if (brush->op == BRUSH_AND) glColor3f(0.0f, 0.0f, 1.0f);
+        else if (brush->op == BRUSH_NOT) glColor3f(0.0f, 0.0f, 0.0f);
+        else glColor3f(1.0f, 0.0f, 0.0f);
         glBegin(GL_LINE_LOOP);
-        glVertex2f(box_start_x, box_start_y);
-        glVertex2f(box_end_x, box_start_y);
-        glVertex2f(box_end_x, box_end_y);
-        glVertex2f(box_start_x, box_end_y);
+        glVertex2f(brush->x0, brush->y0);
+        glVertex2f(brush->x1, brush->y0);
+        glVertex2f(brush->x1, brush->y1);
+        glVertex2f(brush->x0, brush->y1);
         glEnd();
     }
-}
-
-char* read_line(FILE *fp) {
-    char *line = NULL;
-    size_t capacity = 0;
-    size_t len = 0;
-    int ch;
-
-    while ((ch = fgetc(fp)) != EOF && ch != '\n') {
-        if (len + 1 >= capacity) {
-            capacity = capacity == 0 ? 1 : capacity * 2;
-            char *new_line = realloc(line, capacity);
-            if (new_line == NULL) {
-                free(line);
-                return NULL; // Memory allocation failed
-            }
-            line = new_line;
-        }
-        line[len++] = ch;
-    }
-
-    if (len == 0 && ch == EOF) {
-        free(line);
-        return NULL; // End of file reached with no content read
-    }
-
-    // Null-terminate the string
-    char *new_line = realloc(line, len + 1);
-    if (new_line == NULL) {
-        free(line);
-        return NULL; // Memory allocation failed
-    }
-    new_line[len] = '\0';
-    return new_line;
-}
-
-// Function to check if a line segment intersects the bounding box
-bool line_intersects_box(float x1, float y1, float x2, float y2) {
-    // Check if either end of the line segment is inside the bounding box
-    bool start_inside = x1 >= box_start_x && x1 <= box_end_x && y1 >= box_start_y && y1 <= box_end_y;
-    bool end_inside = x2 >= box_start_x && x2 <= box_end_x && y2 >= box_start_y && y2 <= box_end_y;
-    return start_inside || end_inside;
-}
-
-// Function to check intersections and print class counts
-void check_intersections_and_print_counts() {
-    int *class_counts = calloc(num_classes, sizeof(int));
-
-    for (int row = 0; row < global_rows; row++) {
-        bool intersects = false;
-        for (int col = 1; col < global_cols; col++) {
-            if (col == global_class_col_index) continue;
-
-            float x1 = (col - 1) / (float)(global_cols - 1) * stretch_factor_x;
-            float y1 = axis_inverted[col - 1] ? (1.0f - global_data[row][col - 1]) * stretch_factor_y : global_data[row][col - 1] * stretch_factor_y;
-            float x2 = col / (float)(global_cols - 1) * stretch_factor_x;
-            float y2 = axis_inverted[col] ? (1.0f - global_data[row][col]) * stretch_factor_y : global_data[row][col] * stretch_factor_y;
-
-            if (line_intersects_box(x1, y1, x2, y2)) {
-                intersects = true;
-                break;
-            }
-        }
-        if (intersects) {
-            int class_index = (int)global_data[row][global_class_col_index];
-            class_counts[class_index]++;
-        }
-    }
-
-    for (int i = 0; i < num_classes; i++) {
-        printf("Class %s: %d\n", class_info[i].class_name, class_counts[i]);
-    }
-
-    free(class_counts);
+    glPopMatrix();
 }
 
 float point_to_line_dist(float px, float py, float x1, float y1, float x2, float y2) {
@@ -256,34 +484,125 @@ char* trim(char *str) {
     return str;
 }
 
-// Function to get the index of a class label
-int get_class_index(ClassInfo** class_info, int* num_classes, const char* class_label) {
+// Copies len bytes of s plus a terminator into the arena
+char* arena_copy(ArenaBlock** arena, const char* s, size_t len) {
+    const size_t block_size = 64 * 1024;
+    ArenaBlock* block = *arena;
+    if (block == NULL || block->size - block->used < len + 1) {
+        size_t size = len + 1 > block_size ? len + 1 : block_size;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+        if (block == NULL) return NULL;
+        block->next = *arena;
+        block->used = 0;
+        block->size = size;
+        *arena = block;
+    }
+    char* copy = block->data + block->used;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+    return copy;
+}
+
+// FNV-1a hash of a label
+uint32_t hash_label(const char* s, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void class_dict_free(ClassDict* dict) {
+    while (dict->arena) {
+        ArenaBlock* next = dict->arena->next;
+        free(dict->arena);
+        dict->arena = next;
+    }
+    free(dict->class_info);
+    free(dict->hashes);
+    free(dict->slots);
+    memset(dict, 0, sizeof(ClassDict));
+}
+
+// Doubles the slot table and reinserts every entry from its stored hash
+bool class_dict_grow_slots(ClassDict* dict) {
+    int num_slots = dict->num_slots ? dict->num_slots * 2 : 64;
+    int* slots = (int*)calloc(num_slots, sizeof(int));
+    if (slots == NULL) return false;
+    for (int i = 0; i < dict->num_classes; i++) {
+        uint32_t slot = dict->hashes[i] & (num_slots - 1);
+        while (slots[slot]) slot = (slot + 1) & (num_slots - 1);
+        slots[slot] = i + 1;
+    }
+    free(dict->slots);
+    dict->slots = slots;
+    dict->num_slots = num_slots;
+    return true;
+}
+
+// Function to get the index of a class label slice, adding it when unseen.
+// Indices are assigned in first-seen order.
+int get_class_index_range(ClassDict* dict, const char* start, const char* end) {
+    size_t len = (size_t)(end - start);
+    uint32_t hash = hash_label(start, len);
+
     // Check if class label already exists
-    for (int i = 0; i < *num_classes; i++) {
-        if (strcmp((*class_info)[i].class_name, class_label) == 0) {
-            return i; // Class label found, return index
+    if (dict->num_slots > 0) {
+        uint32_t slot = hash & (dict->num_slots - 1);
+        for (; dict->slots[slot]; slot = (slot + 1) & (dict->num_slots - 1)) {
+            int i = dict->slots[slot] - 1;
+            if (dict->hashes[i] == hash && strncmp(dict->class_info[i].class_name, start, len) == 0 && dict->class_info[i].class_name[len] == '\0') {
+                return i; // Class label found, return index
+            }
         }
     }
 
-    // Class label not found, add it to class_info
-    ClassInfo* new_class_info = realloc(*class_info, (*num_classes + 1) * sizeof(ClassInfo));
-    if (new_class_info == NULL) {
-        perror("Memory allocation failed for new_class_info");
+    // Class label not found, add it to the dictionary keeping the load factor under 1/2
+    if ((dict->num_classes + 1) * 2 > dict->num_slots && !class_dict_grow_slots(dict)) {
+        perror("Memory allocation failed for class table");
         return -1;
     }
-    *class_info = new_class_info;
-    (*class_info)[*num_classes].class_name = strdup(class_label);
+    if (dict->num_classes == dict->capacity) {
+        int capacity = dict->capacity ? dict->capacity * 2 : 16;
+        ClassInfo* new_class_info = realloc(dict->class_info, capacity * sizeof(ClassInfo));
+        if (new_class_info != NULL) dict->class_info = new_class_info;
+        uint32_t* new_hashes = realloc(dict->hashes, capacity * sizeof(uint32_t));
+        if (new_hashes != NULL) dict->hashes = new_hashes;
+        if (new_class_info == NULL || new_hashes == NULL) {
+            perror("Memory allocation failed for new_class_info");
+            return -1;
+        }
+        dict->capacity = capacity;
+    }
 
+    ClassInfo* info = &dict->class_info[dict->num_classes];
+    info->class_name = arena_copy(&dict->arena, start, len);
+    if (info->class_name == NULL) {
+        perror("Memory allocation failed for class label");
+        return -1;
+    }
     // Assign a placeholder color, actual color assignment can be done in assign_colors function
-    (*class_info)[*num_classes].r = 0.0f;
-    (*class_info)[*num_classes].g = 0.0f;
-    (*class_info)[*num_classes].b = 0.0f;
-    
+    info->r = 0.0f;
+    info->g = 0.0f;
+    info->b = 0.0f;
+    dict->hashes[dict->num_classes] = hash;
+
+    uint32_t slot = hash & (dict->num_slots - 1);
+    while (dict->slots[slot]) slot = (slot + 1) & (dict->num_slots - 1);
+    dict->slots[slot] = dict->num_classes + 1;
+
     if (DEBUG) {
-        printf("Class Label: '%s', Assigned Index: %d\n", class_label, *num_classes);
+        printf("Class Label: '%s', Assigned Index: %d\n", info->class_name, dict->num_classes);
     }
     // Increase the class count and return the new class index
-    return (*num_classes)++;
+    return dict->num_classes++;
+}
+
+// Function to get the index of a class label
+int get_class_index(ClassDict* dict, const char* class_label) {
+    return get_class_index_range(dict, class_label, class_label + strlen(class_label));
 }
 
 // Function to assign colors to each class
@@ -326,584 +645,5854 @@ char* get_column_value(char* line, int col_index) {
     return trim(value);
 }
 
-void keyboard(unsigned char key, int x, int y) {
-    const float translate_increment = 0.01f;
-    const float scale_increment = 0.01f;
-    const float stretch_increment = 0.01f;
+// Function to get a monotonic timestamp in seconds
+double get_time_seconds() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
 
-    switch (key) {
-        case 27: // exit
-            exit(0);
-            break;
-        case 'r': // increase y stretch
-            stretch_factor_y += stretch_increment;
-            break;
-        case 'f': // decrease y stretch
-            stretch_factor_y = (stretch_factor_y > stretch_increment) ? stretch_factor_y - stretch_increment : 0.1f;
-            break;
-        case 's': // pan down
-            translate_y += translate_increment;
-            break;
-        case 'w': // pan up
-            translate_y -= translate_increment;
-            break;
-        case 'd': // pan right
-            translate_x -= translate_increment;
-            break;
-        case 'a': // pan left
-            translate_x += translate_increment;
-            break;
-        case 'q': // shrink
-            stretch_factor_x = (stretch_factor_x > stretch_increment) ? stretch_factor_x - stretch_increment : 0.1f;
-            break;
-        case 'e': // stretch
-            stretch_factor_x += stretch_increment;
-            break;
-        case '-': // zoom in
-            scale += scale_increment;
-            break;
-        case '+': // zoom out
-            scale = (scale > scale_increment) ? scale - scale_increment : scale_increment;
-            break;
-        default:
-            if (DEBUG) {
-                printf("%d\n", key);
-            }
-    }
-    if (DEBUG) {
-        printf("Transforms %lf, %lf, %lf, %lf, %lf\n", stretch_factor_x, stretch_factor_y, scale, translate_x, translate_y);
-    }
-    glutPostRedisplay();
+// Timers and counters for the hot paths. They only read the clock while the
+// HUD is shown or a trace is written, otherwise each probe is one branch.
+#define PROFILE_SAMPLES 512
+
+enum { STAGE_DISPLAY, STAGE_PARALLEL_COORDS, STAGE_SCATTER_PLOT, STAGE_MOUSE_MOTION, STAGE_BRUSH,
+       STAGE_LOAD, STAGE_NORMALIZE, STAGE_DENSITY, NUM_STAGES };
+
+const char* stage_names[NUM_STAGES] = {
+    "display", "parallel_coords", "scatter_plot", "mouse_motion", "brush", "load", "normalize", "density"
+};
+
+typedef struct {
+    double samples[NUM_STAGES][PROFILE_SAMPLES]; // Recent durations in ms, a ring per stage
+    int count[NUM_STAGES];                       // Samples recorded so far
+    double frame_ms[NUM_STAGES];                 // Time per stage since the previous frame
+    long long frame_vertices, frame_rows_picked; // Counters of the frame in progress
+    long long last_vertices, last_rows_picked;   // Counters of the last finished frame
+    long long frames;
+    double start_time;
+    FILE* trace;                                 // Per-frame samples, CSV or JSON
+    bool trace_json;
+} Profiler;
+
+Profiler profiler;
+bool profiling = false; // Set while the HUD is shown or a trace is written
+
+double profile_start() {
+    return profiling ? get_time_seconds() : 0.0;
 }
 
-void normalize_data(float** data, int rows, int cols, float* min_vals, float* max_vals) {
-    for (int col = 0; col < cols; col++) {
-        if (col == global_class_col_index) continue; // Skip normalization for the class column
+void profile_record(int stage, double seconds) {
+    double ms = seconds * 1000.0;
+    profiler.samples[stage][profiler.count[stage]++ % PROFILE_SAMPLES] = ms;
+    profiler.frame_ms[stage] += ms;
+}
 
-        // Find min and max values for each column
-        min_vals[col] = data[0][col];
-        max_vals[col] = data[0][col];
-        for (int row = 1; row < rows; row++) {
-            if (data[row][col] < min_vals[col]) min_vals[col] = data[row][col];
-            if (data[row][col] > max_vals[col]) max_vals[col] = data[row][col];
-        }
+void profile_end(int stage, double start) {
+    if (profiling) profile_record(stage, get_time_seconds() - start);
+}
 
-        // Normalize data
-        for (int row = 0; row < rows; row++) {
-            data[row][col] = (data[row][col] - min_vals[col]) / (max_vals[col] - min_vals[col]);
-        }
-    }
+void profile_count_vertices(long long count) {
+    if (profiling) profiler.frame_vertices += count;
 }
 
-int count_columns(const char* line) {
-    int cols = 0;
-    const char* tmp = line;
-    while (*tmp) {
-        if (*tmp == ',') cols++;
-        tmp++;
-    }
-    return cols + 1; // Add 1 for the last column
+void profile_count_rows_picked(long long count) {
+    if (profiling) profiler.frame_rows_picked += count;
 }
 
-float** load_csv(const char* filename, int* rows, int* cols, int* class_col_index, ClassInfo** class_info, int* num_classes) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening file");
-        return NULL;
-    }
+double profile_last(int stage) {
+    int count = profiler.count[stage];
+    return count > 0 ? profiler.samples[stage][(count - 1) % PROFILE_SAMPLES] : 0.0;
+}
 
-    char* line;
-    
-    // Read the header line and count columns
-    line = read_line(file);
-    if (line == NULL) {
-        fclose(file);
-        return NULL;
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Median and 99th percentile of a stage's recent samples
+void profile_percentiles(int stage, double* p50, double* p99) {
+    double sorted[PROFILE_SAMPLES];
+    int count = profiler.count[stage] < PROFILE_SAMPLES ? profiler.count[stage] : PROFILE_SAMPLES;
+    *p50 = *p99 = 0.0;
+    if (count == 0) return;
+    memcpy(sorted, profiler.samples[stage], count * sizeof(double));
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    *p50 = sorted[count / 2];
+    *p99 = sorted[(int)(count * 0.99)];
+}
+
+// Ends a frame: appends its stage times and counters to the trace and resets them
+void profile_frame_end() {
+    if (!profiling) return;
+    if (profiler.trace != NULL) {
+        double time_ms = (get_time_seconds() - profiler.start_time) * 1000.0;
+        if (profiler.trace_json) {
+            fprintf(profiler.trace, "%s  {\"frame\": %lld, \"time_ms\": %.3f", profiler.frames > 0 ? ",\n" : "", profiler.frames, time_ms);
+            for (int stage = 0; stage < NUM_STAGES; stage++) {
+                fprintf(profiler.trace, ", \"%s_ms\": %.4f", stage_names[stage], profiler.frame_ms[stage]);
+            }
+            fprintf(profiler.trace, ", \"vertices\": %lld, \"rows_picked\": %lld}", profiler.frame_vertices, profiler.frame_rows_picked);
+        } else {
+            fprintf(profiler.trace, "%lld,%.3f", profiler.frames, time_ms);
+            for (int stage = 0; stage < NUM_STAGES; stage++) fprintf(profiler.trace, ",%.4f", profiler.frame_ms[stage]);
+            fprintf(profiler.trace, ",%lld,%lld\n", profiler.frame_vertices, profiler.frame_rows_picked);
+        }
     }
-    *cols = count_columns(line);
+    profiler.frames++;
+    profiler.last_vertices = profiler.frame_vertices;
+    profiler.last_rows_picked = profiler.frame_rows_picked;
+    profiler.frame_vertices = profiler.frame_rows_picked = 0;
+    memset(profiler.frame_ms, 0, sizeof(profiler.frame_ms));
+}
 
-    // Find the 'class' column index
-    *class_col_index = -1;
-    char* token = strtok(line, ",");
-    for (int i = 0; token != NULL; i++) {
-        char* trimmed_token = trim(token);
-        if (strcasecmp(trimmed_token, "class") == 0) {
-            *class_col_index = i;
+void close_trace() {
+    if (profiler.trace == NULL) return;
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        if (profiler.frame_ms[stage] > 0.0) {
+            profile_frame_end(); // Work after the last frame, such as a final scatter redraw
             break;
         }
-        token = strtok(NULL, ",");
     }
+    if (profiler.trace_json) fprintf(profiler.trace, "\n]\n");
+    fclose(profiler.trace);
+    profiler.trace = NULL;
+}
 
-    if (*class_col_index == -1) {
-        printf("Error: 'class' column not found\n");
-        fclose(file);
-        free(line);
-        return NULL;
+// Starts writing one sample per frame to filename, CSV for .csv and JSON otherwise
+bool open_trace(const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    profiler.trace = fopen(filename, "w");
+    if (profiler.trace == NULL) {
+        perror("Failed to open the trace file");
+        return false;
     }
-    free(line); // Free the memory allocated by read_line
-
-    // Count rows
-    *rows = 0;
-    while ((line = read_line(file)) != NULL) {
-        (*rows)++;
-        free(line); // Free the memory allocated by read_line
-    }
-    rewind(file);
-    free(read_line(file)); // Skip header line and free the memory
-
-    // Allocate memory for data
-    float** data = (float**)malloc(*rows * sizeof(float*));
-    for (int i = 0; i < *rows; i++) {
-        data[i] = (float*)malloc(*cols * sizeof(float));
-    }
-
-    // Process data and class labels
-    *num_classes = 0;
-    *class_info = (ClassInfo*)malloc(sizeof(ClassInfo));
-    for (int i = 0; (line = read_line(file)) != NULL; i++) {
-        token = strtok(line, ",");
-        for (int j = 0; j < *cols; j++) {
-            if (j == *class_col_index) {
-                char* class_label = trim(strdup(token));
-                int label_index = get_class_index(class_info, num_classes, class_label);
-                free(class_label);
-                data[i][j] = (float)label_index;
-            } else {
-                data[i][j] = atof(token);
-            }
-            token = strtok(NULL, ",");
-        }
-        free(line); // Free the memory allocated by read_line
+    profiler.trace_json = ext == NULL || strcmp(ext, ".csv") != 0;
+    profiler.start_time = get_time_seconds();
+    if (profiler.trace_json) {
+        fprintf(profiler.trace, "[\n");
+    } else {
+        fprintf(profiler.trace, "frame,time_ms");
+        for (int stage = 0; stage < NUM_STAGES; stage++) fprintf(profiler.trace, ",%s_ms", stage_names[stage]);
+        fprintf(profiler.trace, ",vertices,rows_picked\n");
+    }
+    profiling = true;
+    atexit(close_trace); // GLUT leaves through exit()
+    return true;
+}
+
+// Function to map a file into memory, returns false on failure. With copy_on_write
+// the pages may be modified in memory without ever touching the file.
+bool map_file(const char* filename, MappedFile* mf, bool copy_on_write) {
+    memset(mf, 0, sizeof(MappedFile));
+#ifdef _WIN32
+    mf->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mf->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mf->file, &size)) {
+        CloseHandle(mf->file);
+        return false;
+    }
+    mf->size = (size_t)size.QuadPart;
+    if (mf->size == 0) return true; // Nothing to map for an empty file
+    mf->mapping = CreateFileMappingA(mf->file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (mf->mapping == NULL) {
+        CloseHandle(mf->file);
+        return false;
+    }
+    mf->data = (const char*)MapViewOfFile(mf->mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (mf->data == NULL) {
+        CloseHandle(mf->mapping);
+        CloseHandle(mf->file);
+        return false;
+    }
+#else
+    mf->fd = open(filename, O_RDONLY);
+    if (mf->fd < 0) {
+        perror("Error opening file");
+        return false;
+    }
+    struct stat st;
+    if (fstat(mf->fd, &st) != 0) {
+        perror("Error reading file size");
+        close(mf->fd);
+        mf->fd = -1;
+        return false;
+    }
+    mf->size = (size_t)st.st_size;
+    if (mf->size == 0) return true; // mmap rejects zero-length mappings
+    void* addr = mmap(NULL, mf->size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, mf->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("Error mapping file");
+        close(mf->fd);
+        mf->fd = -1;
+        return false;
     }
+    if (!copy_on_write) madvise(addr, mf->size, MADV_SEQUENTIAL);
+    mf->data = (const char*)addr;
+#endif
+    return true;
+}
 
-    fclose(file);
+void unmap_file(MappedFile* mf) {
+#ifdef _WIN32
+    if (mf->data) UnmapViewOfFile(mf->data);
+    if (mf->mapping) CloseHandle(mf->mapping);
+    if (mf->file && mf->file != INVALID_HANDLE_VALUE) CloseHandle(mf->file);
+#else
+    if (mf->data) munmap((void*)mf->data, mf->size);
+    if (mf->fd >= 0) close(mf->fd);
+#endif
+    memset(mf, 0, sizeof(MappedFile));
+#ifndef _WIN32
+    mf->fd = -1; // 0 is a valid descriptor
+#endif
+}
 
-    // Assign colors to each unique class
-    assign_colors(*class_info, *num_classes);
+void column_stats_reset(ColumnStats* stats, int cols) {
+    for (int col = 0; col < cols; col++) {
+        stats[col].min = INFINITY;
+        stats[col].max = -INFINITY;
+        stats[col].sum = stats[col].sum_sq = 0.0;
+        stats[col].count = 0;
+    }
+}
 
-    return data;
+void column_stats_add(ColumnStats* stats, float value) {
+    if (isnan(value)) return;
+    if (value < stats->min) stats->min = value;
+    if (value > stats->max) stats->max = value;
+    stats->sum += value;
+    stats->sum_sq += (double)value * value;
+    stats->count++;
 }
 
-int find_or_add_class_label(char*** unique_labels, int* num_labels, const char* label) {
-    // Check if the label already exists
-    for (int i = 0; i < *num_labels; i++) {
-        if (strcmp((*unique_labels)[i], label) == 0) {
-            return i; // Label found, return index
-        }
+void column_stats_merge(ColumnStats* into, const ColumnStats* from, int cols) {
+    for (int col = 0; col < cols; col++) {
+        if (from[col].min < into[col].min) into[col].min = from[col].min;
+        if (from[col].max > into[col].max) into[col].max = from[col].max;
+        into[col].sum += from[col].sum;
+        into[col].sum_sq += from[col].sum_sq;
+        into[col].count += from[col].count;
     }
+}
 
-    // Label not found, add it
-    char** new_labels = realloc(*unique_labels, (*num_labels + 1) * sizeof(char*));
-    if (!new_labels) {
-        perror("Memory allocation failed for new_labels");
-        return -1;
+void* aligned_malloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, COLUMN_ALIGNMENT);
+#else
+    void* ptr = NULL;
+    return posix_memalign(&ptr, COLUMN_ALIGNMENT, size) == 0 ? ptr : NULL;
+#endif
+}
+
+void aligned_free(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Grows (or first allocates) every column of the dataset to hold capacity rows
+bool dataset_reserve(Dataset* ds, size_t capacity) {
+    if (capacity <= ds->capacity) return true;
+    if (ds->quantized) return false; // Compact datasets are final
+    size_t bytes = (capacity > 0 ? capacity : 1) * sizeof(float);
+
+    for (int col = 0; col < ds->cols; col++) {
+        if (col == ds->class_col_index) continue;
+        float* column = (float*)aligned_malloc(bytes);
+        if (column == NULL) return false;
+        if (ds->columns[col]) {
+            memcpy(column, ds->columns[col], ds->rows * sizeof(float));
+            if (!ds->arrays_mapped) aligned_free(ds->columns[col]);
+        }
+        ds->columns[col] = column;
     }
 
-    new_labels[*num_labels] = strdup(label);
-    if (!new_labels[*num_labels]) {
-        perror("Memory allocation failed for label copy");
-        return -1;
+    int* class_ids = (int*)aligned_malloc(bytes);
+    if (class_ids == NULL) return false;
+    if (ds->class_ids) {
+        memcpy(class_ids, ds->class_ids, ds->rows * sizeof(int));
+        if (!ds->arrays_mapped) aligned_free(ds->class_ids);
     }
+    ds->class_ids = class_ids;
+    ds->capacity = capacity;
+    ds->arrays_mapped = false;
+    return true;
+}
 
-    *unique_labels = new_labels;
-    return (*num_labels)++;
+// Seeks to a 64-bit file offset
+bool seek_file(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
 }
 
-void draw_parallel_coordinates(float** data, int rows, int cols, int class_col_index, ClassInfo* class_info, int num_classes, float* density) {
-    // Iterate through each row (data point)
-    for (int row = 0; row < rows; row++) {
-        // Skip the hovered row for highlighting
-        if (row == hovered_row) continue;
-        
-        int class_index = (int)data[row][class_col_index];
-        glColor3f(class_info[class_index].r, class_info[class_index].g, class_info[class_index].b);
+void tile_store_free(TileStore* store) {
+    if (store == NULL) return;
+    if (store->file != NULL) fclose(store->file);
+#ifdef _WIN32
+    if (store->file != NULL) remove(store->path);
+#endif
+    for (int p = 0; store->pages && p < store->num_pages; p++) {
+        aligned_free(store->pages[p].values);
+    }
+    free(store->pages);
+    free(store->chunk_pages);
+    free(store->profile);
+    free(store->profile_scale);
+    free(store->path);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
+}
 
-        glBegin(GL_LINE_STRIP);
-        for (int col = 0; col < cols; col++) {
-            if (col == global_class_col_index) continue;
+// Creates an empty tile file next to the CSV with a page cache of at most
+// budget bytes, though never fewer than two pages per column, so a row block
+// of every column stays cached while it is read
+TileStore* tile_store_create(const char* csv_file, int cols, int class_col_index, size_t budget) {
+    TileStore* store = (TileStore*)calloc(1, sizeof(TileStore));
+    if (store == NULL) return NULL;
+    pthread_mutex_init(&store->lock, NULL);
+    store->cols = cols;
+    store->class_col_index = class_col_index;
+    size_t pages = budget / (TILE_ROWS * sizeof(float));
+    if (pages < (size_t)cols * 2) {
+        pages = (size_t)cols * 2;
+        printf("The page cache needs %zu MB for %d columns, over the memory budget.\n", (pages * TILE_ROWS * sizeof(float)) >> 20, cols);
+    }
+    store->num_pages = pages > INT32_MAX ? INT32_MAX : (int)pages;
+    store->pages = (TilePage*)calloc(store->num_pages, sizeof(TilePage));
+    store->path = (char*)malloc(strlen(csv_file) + 9);
+    if (store->pages == NULL || store->path == NULL) {
+        perror("Memory allocation failed for the tile store");
+        tile_store_free(store);
+        return NULL;
+    }
+    for (int p = 0; p < store->num_pages; p++) store->pages[p].chunk = -1;
 
-            // Adjust line thickness based on density
-            glLineWidth(1.0f + density[row * cols + col] * 0.1f); // Example scaling factor for line width
+    sprintf(store->path, "%s.cvtiles", csv_file);
+    store->file = fopen(store->path, "w+b");
+    if (store->file == NULL) {
+        perror(store->path);
+        tile_store_free(store);
+        return NULL;
+    }
+#ifndef _WIN32
+    // The open file outlives its name, so the tiles go away however the process ends
+    unlink(store->path);
+#endif
+    setvbuf(store->file, NULL, _IONBF, 0); // Chunks are read and written whole
+    return store;
+}
 
-            float x = (col / (float)(cols - 1)) * stretch_factor_x;
-            float y = axis_inverted[col] ? (1.0f - data[row][col]) * stretch_factor_y : data[row][col] * stretch_factor_y;
-            glVertex2f(x, y);
+// Writes rows [first, first + count) of the in-memory arrays of ds as the next
+// tile, count <= TILE_ROWS. Only the last tile may be short; its chunks keep
+// the full stride, so the file has a hole where they end.
+bool tile_store_append(TileStore* store, const Dataset* ds, int first, int count) {
+    int tile = store->rows / TILE_ROWS;
+    int* chunk_pages = (int*)realloc(store->chunk_pages, (size_t)(tile + 1) * store->cols * sizeof(int));
+    if (chunk_pages == NULL) {
+        perror("Memory allocation failed for the tile store");
+        return false;
+    }
+    store->chunk_pages = chunk_pages;
+    for (int col = 0; col < store->cols; col++) {
+        int chunk = tile * store->cols + col;
+        const void* values = col == store->class_col_index ? (const void*)(ds->class_ids + first) : (const void*)(ds->columns[col] + first);
+        chunk_pages[chunk] = -1;
+        if (!seek_file(store->file, (uint64_t)chunk * TILE_ROWS * sizeof(float)) ||
+            fwrite(values, sizeof(float), count, store->file) != (size_t)count) {
+            perror(store->path);
+            return false;
         }
-        glEnd();
     }
+    store->rows += count;
+    return true;
+}
 
-    // Now draw the highlighted polyline
-    if (hovered_row >= 0) {
-        glColor3f(1.0f, 1.0f, 0.0f); // Highlight color
-        glLineWidth(3.0f); // Increase line width for highlighting
-        glBegin(GL_LINE_STRIP);
-        for (int col = 0; col < cols; col++) {
-            if (col == global_class_col_index) continue;
-            float x = (col / (float)(cols - 1)) * stretch_factor_x;
-            float y = axis_inverted[col] ? (1.0f - data[hovered_row][col]) * stretch_factor_y : data[hovered_row][col] * stretch_factor_y;
-            glVertex2f(x, y);
+// Page holding one column of one tile, read into the least recently used page
+// on a miss and normalized with the store's maps. Call with the store locked.
+TilePage* tile_store_page(TileStore* store, int tile, int col) {
+    int chunk = tile * store->cols + col;
+    int p = store->chunk_pages[chunk];
+    if (p < 0) {
+        p = 0;
+        for (int i = 1; i < store->num_pages; i++) {
+            if (store->pages[i].last_used < store->pages[p].last_used) p = i;
         }
-        glEnd();
-        glLineWidth(1.0f); // Reset line width back to default
+        TilePage* page = &store->pages[p];
+        if (page->chunk >= 0) store->chunk_pages[page->chunk] = -1;
+        page->chunk = -1;
+        if (page->values == NULL) page->values = (float*)aligned_malloc(TILE_ROWS * sizeof(float));
+        int count = store->rows - tile * TILE_ROWS < TILE_ROWS ? store->rows - tile * TILE_ROWS : TILE_ROWS;
+        if (page->values == NULL || !seek_file(store->file, (uint64_t)chunk * TILE_ROWS * sizeof(float)) ||
+            fread(page->values, sizeof(float), count, store->file) != (size_t)count) {
+            perror(store->path);
+            return NULL;
+        }
+        if (col != store->class_col_index && store->maps != NULL) {
+            const ColumnMap* map = &store->maps[col];
+            for (int i = 0; i < count; i++) page->values[i] = (page->values[i] - map->shift) * map->scale + map->offset;
+        }
+        page->chunk = chunk;
+        store->chunk_pages[chunk] = p;
+        store->chunks_read++;
     }
+    store->pages[p].last_used = ++store->clock;
+    return &store->pages[p];
 }
 
-void renderBitmapString(float x, float y, void *font, char *string) {
-    char *c;
-    glRasterPos2f(x, y);
-    for (c = string; *c != '\0'; c++) {
-        glutBitmapCharacter(font, *c);
+// Copies rows [first, first + count) of a column out of the page cache, class
+// ids for the class column. Rows of unreadable chunks come out missing, class 0.
+void tile_store_read(TileStore* store, int col, int first, int count, void* out) {
+    char* dst = (char*)out;
+    pthread_mutex_lock(&store->lock);
+    while (count > 0) {
+        int tile = first / TILE_ROWS, offset = first % TILE_ROWS;
+        int n = TILE_ROWS - offset < count ? TILE_ROWS - offset : count;
+        TilePage* page = tile_store_page(store, tile, col);
+        if (page != NULL) {
+            memcpy(dst, page->values + offset, n * sizeof(float));
+        } else if (col == store->class_col_index) {
+            memset(dst, 0, n * sizeof(int));
+        } else {
+            for (int i = 0; i < n; i++) ((float*)dst)[i] = NAN;
+        }
+        dst += n * sizeof(float);
+        first += n;
+        count -= n;
     }
+    pthread_mutex_unlock(&store->lock);
 }
 
-void draw_axis_labels() {
-    if (closest_axis1 != -1 && closest_axis2 != -1) {
-        char axis1_label[50], axis2_label[50];
-        sprintf(axis1_label, "Axis %d", closest_axis1 + 1);
-        sprintf(axis2_label, "Axis %d", closest_axis2 + 1);
+void dataset_free(Dataset* ds) {
+    if (ds == NULL) return;
+    for (int col = 0; ds->columns && col < ds->cols && !ds->arrays_mapped; col++) {
+        aligned_free(ds->columns[col]);
+    }
+    free(ds->columns);
+    if (!ds->arrays_mapped) aligned_free(ds->class_ids);
+    if (ds->mapping) {
+        unmap_file(ds->mapping);
+        free(ds->mapping);
+    }
+    for (int col = 0; ds->sorted_rows && col < ds->cols; col++) {
+        aligned_free(ds->sorted_rows[col]);
+    }
+    free(ds->sorted_rows);
+    for (int col = 0; ds->quantized && col < ds->cols; col++) {
+        aligned_free(ds->quantized[col]);
+    }
+    free(ds->quantized);
+    free(ds->stats);
+    free(ds->maps);
+    tile_store_free(ds->tiles);
+    for (int col = 0; ds->categories && col < ds->cols; col++) {
+        class_dict_free(&ds->categories[col]);
+    }
+    free(ds->categories);
+    free(ds->categorical);
+    free(ds);
+}
 
-        glColor3f(0.0, 0.0, 0.0); // Black color for text
-        renderBitmapString(0.1, 0.95, GLUT_BITMAP_HELVETICA_18, axis1_label); // Render Axis 1 label
-        renderBitmapString(0.1, 0.9, GLUT_BITMAP_HELVETICA_18, axis2_label);  // Render Axis 2 label
+Dataset* dataset_create(int cols, int class_col_index, size_t capacity) {
+    Dataset* ds = (Dataset*)calloc(1, sizeof(Dataset));
+    if (ds == NULL) return NULL;
+    ds->cols = cols;
+    ds->class_col_index = class_col_index;
+    ds->columns = (float**)calloc(cols, sizeof(float*));
+    ds->stats = (ColumnStats*)malloc(cols * sizeof(ColumnStats));
+    if (ds->columns == NULL || ds->stats == NULL || !dataset_reserve(ds, capacity)) {
+        perror("Memory allocation failed for dataset");
+        dataset_free(ds);
+        return NULL;
     }
+    column_stats_reset(ds->stats, cols);
+    return ds;
 }
 
-// Function to convert window coordinates to world coordinates
-void window_to_world(int x, int y, float *world_x, float *world_y) {
-    // Get the size of the window
-    int width = glutGet(GLUT_WINDOW_WIDTH);
-    int height = glutGet(GLUT_WINDOW_HEIGHT);
+uint16_t quantize_value(float value) {
+    if (isnan(value)) return QUANT_NAN;
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return (uint16_t)(value * QUANT_MAX + 0.5f);
+}
 
-    // Normalize the mouse coordinates to range [0, 1]
-    *world_x = (float)x / (float)width;
-    *world_y = 1.0f - (float)y / (float)height; // Invert y since window coordinates origin is top left
+float dequantize_value(uint16_t level) {
+    return level == QUANT_NAN ? NAN : level * (1.0f / QUANT_MAX);
+}
 
-    // Apply the inverse of the scaling transformation
-    *world_x = (*world_x - translate_x) / scale;
-    *world_y = (*world_y - translate_y) / scale;
+// Normalized value of one cell, whichever storage the dataset uses
+float dataset_value(const Dataset* ds, int col, int row) {
+    if (ds->tiles != NULL) {
+        float value;
+        tile_store_read(ds->tiles, col, row, 1, &value);
+        return value;
+    }
+    return ds->quantized ? dequantize_value(ds->quantized[col][row]) : ds->columns[col][row];
+}
+
+// Values of rows [first, first + count) of a column, count <= COLUMN_BLOCK_ROWS.
+// Float columns are returned in place, compact ones are dequantized into scratch
+// and out-of-core ones copied there from the page cache.
+const float* column_block(const Dataset* ds, int col, int first, int count, float* scratch) {
+    if (ds->tiles != NULL) {
+        tile_store_read(ds->tiles, col, first, count, scratch);
+        return scratch;
+    }
+    if (ds->quantized == NULL) return ds->columns[col] + first;
+    const uint16_t* levels = ds->quantized[col] + first;
+    for (int i = 0; i < count; i++) scratch[i] = dequantize_value(levels[i]);
+    return scratch;
+}
+
+// Class ids of rows [first, first + count), count <= COLUMN_BLOCK_ROWS, in
+// place or, out of core, copied into scratch
+const int* class_block(const Dataset* ds, int first, int count, int* scratch) {
+    if (ds->tiles == NULL) return ds->class_ids + first;
+    tile_store_read(ds->tiles, ds->class_col_index, first, count, scratch);
+    return scratch;
+}
+
+// Replaces the normalized float columns with 16-bit fixed point, halving their size
+bool compact_dataset(Dataset* ds) {
+    if (ds->quantized) return true;
+    ds->quantized = (uint16_t**)calloc(ds->cols, sizeof(uint16_t*));
+    if (ds->quantized == NULL) return false;
+    for (int col = 0; col < ds->cols; col++) {
+        if (col == ds->class_col_index) continue;
+        uint16_t* levels = (uint16_t*)aligned_malloc((ds->rows > 0 ? ds->rows : 1) * sizeof(uint16_t));
+        if (levels == NULL) {
+            perror("Memory allocation failed for compact columns");
+            return false;
+        }
+        for (int row = 0; row < ds->rows; row++) levels[row] = quantize_value(ds->columns[col][row]);
+        ds->quantized[col] = levels;
+
+        // Free each float column right away so the peak stays near the float size
+        if (!ds->arrays_mapped) aligned_free(ds->columns[col]);
+        ds->columns[col] = NULL;
+    }
+    return true;
+}
+
+// Worker pool size used by the parallel stages, 1 keeps everything serial
+int num_threads = 1;
+
+int get_cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+typedef void (*ParallelTask)(void* ctx, int task);
+
+typedef struct {
+    ParallelTask task;
+    void* ctx;
+    int num_tasks;
+    int next_task;
+} ParallelJob;
+
+void* parallel_worker(void* arg) {
+    ParallelJob* job = (ParallelJob*)arg;
+    int task;
+    while ((task = __atomic_fetch_add(&job->next_task, 1, __ATOMIC_RELAXED)) < job->num_tasks) {
+        job->task(job->ctx, task);
+    }
+    return NULL;
+}
+
+// Runs task(ctx, 0..num_tasks-1) across the worker pool and waits for all of them
+void run_parallel(int num_tasks, ParallelTask task, void* ctx) {
+    int workers = num_threads < num_tasks ? num_threads : num_tasks;
+    ParallelJob job = { task, ctx, num_tasks, 0 };
+    if (workers <= 1) {
+        parallel_worker(&job);
+        return;
+    }
+
+    pthread_t* threads = (pthread_t*)malloc((workers - 1) * sizeof(pthread_t));
+    int started = 0;
+    for (; threads != NULL && started < workers - 1; started++) {
+        if (pthread_create(&threads[started], NULL, parallel_worker, &job) != 0) break;
+    }
+    parallel_worker(&job); // The calling thread works too
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// Parses a number from [p, end) with the same leniency as atof: leading
+// blanks are skipped and trailing text is ignored. Fields without a number,
+// empty ones or markers such as "NA" or "?", yield NaN, a missing value.
+float parse_float(const char* p, const char* end) {
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p == end) return NAN;
+
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Rare spellings such as "inf" or "nan" go through strtod
+    if (p < end && isalpha((unsigned char)*p)) {
+        char buffer[64];
+        size_t len = (size_t)(end - p) < sizeof(buffer) - 1 ? (size_t)(end - p) : sizeof(buffer) - 1;
+        memcpy(buffer, p, len);
+        buffer[len] = '\0';
+        char* parsed;
+        float value = (float)strtod(buffer, &parsed);
+        if (parsed == buffer) return NAN;
+        return negative ? -value : value;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    const char* first_digit = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++; // Digits beyond double precision only shift the exponent
+        }
+        p++;
+    }
+    bool any_digit = p > first_digit;
+    if (p < end && *p == '.') {
+        p++;
+        any_digit = any_digit || (p < end && *p >= '0' && *p <= '9');
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (unsigned)(*p - '0');
+                if (mantissa) digits++;
+                exponent--;
+            }
+            p++;
+        }
+    }
+    if (!any_digit) return NAN;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool exp_negative = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_negative = *q == '-';
+            q++;
+        }
+        if (q < end && *q >= '0' && *q <= '9') {
+            int exp_value = 0;
+            while (q < end && *q >= '0' && *q <= '9') {
+                if (exp_value < 10000) exp_value = exp_value * 10 + (*q - '0');
+                q++;
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+    }
+
+    double value = (double)mantissa;
+    if (exponent != 0 && mantissa != 0) {
+        if (exponent > 0 && exponent <= 22) value *= powers_of_ten[exponent];
+        else if (exponent < 0 && exponent >= -22) value /= powers_of_ten[-exponent];
+        else value *= pow(10.0, exponent);
+    }
+    return (float)(negative ? -value : value);
+}
+
+// Function to trim whitespace from both ends of a [start, end) slice
+void trim_range(const char** start, const char** end) {
+    while (*start < *end && isspace((unsigned char)**start)) (*start)++;
+    while (*end > *start && isspace((unsigned char)*(*end - 1))) (*end)--;
+}
+
+// Whether a trimmed field is empty or a common marker of a missing value
+bool field_is_missing(const char* p, const char* end) {
+    static const char* markers[] = { "na", "n/a", "null", "none", "?", "-", "--", "." };
+    size_t len = (size_t)(end - p);
+    if (len == 0) return true;
+    for (size_t i = 0; i < sizeof(markers) / sizeof(markers[0]); i++) {
+        if (strlen(markers[i]) == len && strncasecmp(p, markers[i], len) == 0) return true;
+    }
+    return false;
+}
+
+// Parses one CSV record [line, line_end) into row of the dataset columns.
+// Missing trailing fields, empty fields and text that is not a number are
+// stored as NaN, extra fields are ignored. Values of categorical columns are
+// interned into categories[col] and stored as their code, missing ones as NaN.
+void parse_row(const char* line, const char* line_end, Dataset* ds, size_t row, ClassDict* classes, ClassDict* categories, ColumnStats* stats) {
+    const char* p = line;
+    for (int j = 0; j < ds->cols; j++) {
+        const char* field_end = line_end;
+        if (p > line_end) {
+            p = field_end = line_end; // Missing field, read as empty
+        } else {
+            field_end = memchr(p, ',', (size_t)(line_end - p));
+            if (field_end == NULL) field_end = line_end;
+        }
+
+        if (j == ds->class_col_index) {
+            const char* label_start = p;
+            const char* label_end = field_end;
+            trim_range(&label_start, &label_end);
+            ds->class_ids[row] = get_class_index_range(classes, label_start, label_end);
+        } else if (ds->categorical != NULL && ds->categorical[j]) {
+            const char* label_start = p;
+            const char* label_end = field_end;
+            trim_range(&label_start, &label_end);
+            int code = field_is_missing(label_start, label_end) ? -1 : get_class_index_range(&categories[j], label_start, label_end);
+            float value = code >= 0 ? (float)code : NAN;
+            ds->columns[j][row] = value;
+            column_stats_add(&stats[j], value);
+        } else {
+            float value = parse_float(p, field_end);
+            ds->columns[j][row] = value;
+            column_stats_add(&stats[j], value);
+        }
+        p = field_end + 1;
+    }
+}
+
+// Finds the record starting at p. Returns false when the line is blank.
+bool next_record(const char* p, const char* end, const char** line_end, const char** next) {
+    const char* eol = memchr(p, '\n', (size_t)(end - p));
+    if (eol == NULL) eol = end;
+    *next = eol < end ? eol + 1 : end;
+    if (eol > p && eol[-1] == '\r') eol--;
+    *line_end = eol;
+
+    while (p < eol && isspace((unsigned char)*p)) p++;
+    return p < eol;
+}
+
+// Parses every record serially, growing the columns geometrically
+bool parse_records_serial(const char* p, const char* end, Dataset* ds, ClassDict* classes) {
+    while (p < end) {
+        const char* line_end;
+        const char* next;
+        if (!next_record(p, end, &line_end, &next)) {
+            p = next;
+            continue;
+        }
+
+        if ((size_t)ds->rows == ds->capacity && !dataset_reserve(ds, ds->capacity * 2)) {
+            perror("Memory allocation failed for data");
+            return false;
+        }
+
+        parse_row(p, line_end, ds, ds->rows, classes, ds->categories, ds->stats);
+        ds->rows++;
+        p = next;
+    }
+    return true;
+}
+
+// One newline-aligned slice of the input with its own class dictionary
+typedef struct {
+    const char* start;
+    const char* end;
+    size_t first_row;
+    int rows;
+    ClassDict classes;
+    int* class_remap;
+    ClassDict* categories; // Chunk-local category dictionaries, NULL without categorical columns
+    int** category_remaps;
+    ColumnStats* stats;    // Merged into the dataset's after parsing
+} ParseChunk;
+
+typedef struct {
+    ParseChunk* chunks;
+    Dataset* ds;
+} ParseJob;
+
+void count_chunk_rows(void* ctx, int task) {
+    ParseChunk* chunk = &((ParseJob*)ctx)->chunks[task];
+    const char* p = chunk->start;
+    chunk->rows = 0;
+    while (p < chunk->end) {
+        const char* line_end;
+        const char* next;
+        if (next_record(p, chunk->end, &line_end, &next)) chunk->rows++;
+        p = next;
+    }
+}
+
+void parse_chunk(void* ctx, int task) {
+    ParseJob* job = (ParseJob*)ctx;
+    ParseChunk* chunk = &job->chunks[task];
+    size_t row = chunk->first_row;
+    const char* p = chunk->start;
+    while (p < chunk->end) {
+        const char* line_end;
+        const char* next;
+        if (next_record(p, chunk->end, &line_end, &next)) {
+            parse_row(p, line_end, job->ds, row++, &chunk->classes, chunk->categories, chunk->stats);
+        }
+        p = next;
+    }
+}
+
+// Rewrites chunk-local class indices and category codes to the merged global ones
+void remap_chunk_classes(void* ctx, int task) {
+    ParseJob* job = (ParseJob*)ctx;
+    ParseChunk* chunk = &job->chunks[task];
+    int* class_ids = job->ds->class_ids + chunk->first_row;
+    for (int i = 0; i < chunk->rows; i++) {
+        class_ids[i] = chunk->class_remap[class_ids[i]];
+    }
+    for (int col = 0; chunk->categories && col < job->ds->cols; col++) {
+        if (!job->ds->categorical[col]) continue;
+        float* codes = job->ds->columns[col] + chunk->first_row;
+        const int* remap = chunk->category_remaps[col];
+        for (int i = 0; i < chunk->rows; i++) {
+            if (!isnan(codes[i])) codes[i] = (float)remap[(int)codes[i]];
+        }
+    }
+}
+
+// Splits the input at newline boundaries and parses the pieces on the worker pool,
+// appending after the rows already in ds. Chunk dictionaries are merged in file
+// order, so class indices match a serial parse.
+bool parse_records_parallel(const char* p, const char* end, Dataset* ds, ClassDict* classes) {
+    int num_chunks = num_threads;
+    ParseChunk* chunks = (ParseChunk*)calloc(num_chunks, sizeof(ParseChunk));
+    if (chunks == NULL) {
+        perror("Memory allocation failed for parse chunks");
+        return false;
+    }
+
+    size_t chunk_size = (size_t)(end - p) / num_chunks;
+    const char* chunk_start = p;
+    for (int i = 0; i < num_chunks; i++) {
+        const char* chunk_end = end;
+        if (i < num_chunks - 1 && chunk_start + chunk_size < end) {
+            chunk_end = memchr(chunk_start + chunk_size, '\n', (size_t)(end - chunk_start - chunk_size));
+            chunk_end = chunk_end ? chunk_end + 1 : end;
+        }
+        chunks[i].start = chunk_start;
+        chunks[i].end = chunk_end > chunk_start ? chunk_end : chunk_start;
+        chunk_start = chunks[i].end;
+    }
+
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].stats = (ColumnStats*)malloc(ds->cols * sizeof(ColumnStats));
+        if (ds->categorical != NULL) {
+            chunks[i].categories = (ClassDict*)calloc(ds->cols, sizeof(ClassDict));
+            chunks[i].category_remaps = (int**)calloc(ds->cols, sizeof(int*));
+        }
+        if (chunks[i].stats == NULL || (ds->categorical != NULL && (chunks[i].categories == NULL || chunks[i].category_remaps == NULL))) {
+            perror("Memory allocation failed for parse chunks");
+            for (int j = 0; j <= i; j++) {
+                free(chunks[j].stats);
+                free(chunks[j].categories);
+                free(chunks[j].category_remaps);
+            }
+            free(chunks);
+            return false;
+        }
+        column_stats_reset(chunks[i].stats, ds->cols);
+    }
+    ParseJob job = { chunks, ds };
+
+    // Count records per chunk so every chunk can write straight into the final columns
+    run_parallel(num_chunks, count_chunk_rows, &job);
+    size_t total_rows = ds->rows;
+    for (int i = 0; i < num_chunks; i++) {
+        chunks[i].first_row = total_rows;
+        total_rows += chunks[i].rows;
+    }
+
+    // Batched loads append repeatedly, so grow at least geometrically
+    size_t capacity = ds->capacity;
+    if (capacity < total_rows) capacity = ds->rows > 0 && total_rows < capacity * 2 ? capacity * 2 : total_rows;
+    bool ok = dataset_reserve(ds, capacity);
+    if (ok) {
+        run_parallel(num_chunks, parse_chunk, &job);
+        ds->rows = (int)total_rows;
+
+        // Merge the chunk dictionaries in file order
+        for (int i = 0; i < num_chunks; i++) {
+            ClassDict* local = &chunks[i].classes;
+            chunks[i].class_remap = (int*)malloc((local->num_classes > 0 ? local->num_classes : 1) * sizeof(int));
+            for (int j = 0; chunks[i].class_remap && j < local->num_classes; j++) {
+                chunks[i].class_remap[j] = get_class_index(classes, local->class_info[j].class_name);
+            }
+            if (chunks[i].class_remap == NULL) ok = false;
+            for (int col = 0; chunks[i].categories && col < ds->cols; col++) {
+                local = &chunks[i].categories[col];
+                if (!ds->categorical[col]) continue;
+                int* remap = (int*)malloc((local->num_classes > 0 ? local->num_classes : 1) * sizeof(int));
+                chunks[i].category_remaps[col] = remap;
+                for (int j = 0; remap && j < local->num_classes; j++) {
+                    remap[j] = get_class_index(&ds->categories[col], local->class_info[j].class_name);
+                }
+                if (remap == NULL) ok = false;
+            }
+        }
+        if (ok) run_parallel(num_chunks, remap_chunk_classes, &job);
+        for (int i = 0; i < num_chunks; i++) column_stats_merge(ds->stats, chunks[i].stats, ds->cols);
+
+        // Chunks counted their local codes; the merged ones run up to the categories seen
+        for (int col = 0; ds->categorical && col < ds->cols; col++) {
+            if (ds->categorical[col] && ds->stats[col].count > 0) ds->stats[col].max = (float)(ds->categories[col].num_classes - 1);
+        }
+        if (!ok) perror("Memory allocation failed for class and category codes");
+    } else {
+        perror("Memory allocation failed for data");
+    }
+
+    for (int i = 0; i < num_chunks; i++) {
+        class_dict_free(&chunks[i].classes);
+        free(chunks[i].class_remap);
+        for (int col = 0; chunks[i].categories && col < ds->cols; col++) {
+            class_dict_free(&chunks[i].categories[col]);
+            free(chunks[i].category_remaps[col]);
+        }
+        free(chunks[i].categories);
+        free(chunks[i].category_remaps);
+        free(chunks[i].stats);
+    }
+    free(chunks);
+    return ok;
+}
+
+// Appends the records in [p, end) to ds, in parallel when the input is large enough
+bool parse_records(const char* p, const char* end, Dataset* ds, ClassDict* classes) {
+    if (num_threads > 1 && (size_t)(end - p) >= PARALLEL_PARSE_MIN_BYTES) {
+        return parse_records_parallel(p, end, ds, classes);
+    }
+    return parse_records_serial(p, end, ds, classes);
+}
+
+// Whether a trimmed field reads as a number: an optional sign, then digits
+// with an optional point and exponent, or an inf/nan spelling
+bool field_is_number(const char* p, const char* end) {
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    size_t len = (size_t)(end - p);
+    if ((len == 3 && (strncasecmp(p, "inf", 3) == 0 || strncasecmp(p, "nan", 3) == 0)) ||
+        (len == 8 && strncasecmp(p, "infinity", 8) == 0)) {
+        return true;
+    }
+    bool digits = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) digits = true;
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) digits = true;
+    }
+    if (!digits) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) p++;
+        if (p == end || *p < '0' || *p > '9') return false;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    return p == end;
+}
+
+// Marks the columns with text that is not a number among the first
+// TYPE_SAMPLE_ROWS records as categorical, each with an empty dictionary.
+// Empty fields and missing value markers such as "NA" or "?" do not count.
+bool infer_column_types(Dataset* ds, const char* p, const char* end) {
+    bool* categorical = (bool*)calloc(ds->cols, sizeof(bool));
+    if (categorical == NULL) {
+        perror("Memory allocation failed for column types");
+        return false;
+    }
+    int num_categorical = 0;
+    for (int sampled = 0; p < end && sampled < TYPE_SAMPLE_ROWS;) {
+        const char* line_end;
+        const char* next;
+        if (next_record(p, end, &line_end, &next)) {
+            sampled++;
+            const char* field = p;
+            for (int j = 0; j < ds->cols && field <= line_end; j++) {
+                const char* field_end = memchr(field, ',', (size_t)(line_end - field));
+                if (field_end == NULL) field_end = line_end;
+                const char* value_start = field;
+                const char* value_end = field_end;
+                trim_range(&value_start, &value_end);
+                if (j != ds->class_col_index && !categorical[j] && !field_is_missing(value_start, value_end) && !field_is_number(value_start, value_end)) {
+                    categorical[j] = true;
+                    num_categorical++;
+                }
+                field = field_end + 1;
+            }
+        }
+        p = next;
+    }
+    if (num_categorical == 0) {
+        free(categorical);
+        return true;
+    }
+    ds->categories = (ClassDict*)calloc(ds->cols, sizeof(ClassDict));
+    if (ds->categories == NULL) {
+        perror("Memory allocation failed for category dictionaries");
+        free(categorical);
+        return false;
+    }
+    ds->categorical = categorical;
+    return true;
+}
+
+// Called after every batch of a progressive load with the rows parsed so far;
+// returning false stops the load
+typedef bool (*LoadProgress)(void* ctx, Dataset* ds, ClassDict* classes, size_t bytes_done, size_t bytes_total);
+
+// Loads a CSV into a new dataset. With a progress callback the file is parsed
+// in batches of LOAD_BATCH_BYTES and the callback sees the dataset after each.
+Dataset* load_csv(const char* filename, ClassDict* classes, LoadProgress progress, void* ctx) {
+    double start_time = get_time_seconds();
+
+    MappedFile mf;
+    if (!map_file(filename, &mf, false)) {
+        return NULL;
+    }
+
+    const char* p = mf.data;
+    const char* end = mf.data + mf.size;
+
+    // Skip a UTF-8 byte order mark
+    if (mf.size >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+
+    // Read the header line and find the 'class' column index
+    const char* header_end = p < end ? memchr(p, '\n', (size_t)(end - p)) : NULL;
+    if (header_end == NULL) header_end = end;
+    if (header_end == p) {
+        printf("Error: missing CSV header\n");
+        unmap_file(&mf);
+        return NULL;
+    }
+
+    int cols = 0;
+    int class_col_index = -1;
+    for (const char* field = p; field <= header_end; cols++) {
+        const char* field_end = memchr(field, ',', (size_t)(header_end - field));
+        if (field_end == NULL) field_end = header_end;
+        const char* name_start = field;
+        const char* name_end = field_end;
+        trim_range(&name_start, &name_end);
+        if (class_col_index == -1 && name_end - name_start == 5 && strncasecmp(name_start, "class", 5) == 0) {
+            class_col_index = cols;
+        }
+        field = field_end + 1;
+    }
+
+    if (class_col_index == -1) {
+        printf("Error: 'class' column not found\n");
+        unmap_file(&mf);
+        return NULL;
+    }
+    p = header_end < end ? header_end + 1 : end;
+
+    Dataset* ds = dataset_create(cols, class_col_index, 1024);
+    if (ds == NULL || !infer_column_types(ds, p, end)) {
+        dataset_free(ds);
+        unmap_file(&mf);
+        return NULL;
+    }
+
+    memset(classes, 0, sizeof(ClassDict));
+    bool ok = true;
+    if (progress == NULL) {
+        ok = parse_records(p, end, ds, classes);
+    }
+    while (progress != NULL && ok && p < end) {
+        const char* batch_end = end;
+        if ((size_t)(end - p) > LOAD_BATCH_BYTES) {
+            batch_end = memchr(p + LOAD_BATCH_BYTES, '\n', (size_t)(end - p) - LOAD_BATCH_BYTES);
+            batch_end = batch_end ? batch_end + 1 : end;
+        }
+        ok = parse_records(p, batch_end, ds, classes);
+        if (ok) ok = progress(ctx, ds, classes, (size_t)(batch_end - mf.data), mf.size);
+        p = batch_end;
+    }
+    unmap_file(&mf);
+    if (!ok) {
+        dataset_free(ds);
+        return NULL;
+    }
+
+    // Assign colors to each unique class
+    assign_colors(classes->class_info, classes->num_classes);
+
+    // Rows a progress callback moved out of core count too
+    int rows = ds->rows + (ds->tiles != NULL ? ds->tiles->rows : 0);
+    double elapsed = get_time_seconds() - start_time;
+    printf("Loaded %d rows x %d columns in %.3f s (%.0f rows/sec)\n", rows, ds->cols, elapsed, elapsed > 0 ? rows / elapsed : 0.0);
+    for (int col = 0; ds->categorical && col < ds->cols; col++) {
+        if (ds->categorical[col]) printf("Column %d is categorical with %d values\n", col + 1, ds->categories[col].num_classes);
+    }
+
+    return ds;
+}
+
+typedef struct {
+    Dataset* ds;
+    const ColumnMap* maps;
+    int first_row, last_row; // Rows outside [first_row, last_row) are left alone
+} NormalizeJob;
+
+void normalize_column_task(void* ctx, int col) {
+    NormalizeJob* job = (NormalizeJob*)ctx;
+    Dataset* ds = job->ds;
+    if (col == ds->class_col_index) return;
+    float* values = ds->columns[col];
+    const ColumnMap* map = &job->maps[col];
+    int row = job->first_row, last = job->last_row;
+#ifdef __SSE2__
+    for (; row < last && row % 4 != 0; row++) {
+        values[row] = (values[row] - map->shift) * map->scale + map->offset;
+    }
+    __m128 shift = _mm_set1_ps(map->shift);
+    __m128 scale = _mm_set1_ps(map->scale);
+    __m128 offset = _mm_set1_ps(map->offset);
+    for (; row + 4 <= last; row += 4) { // Columns are 64-byte aligned
+        __m128 v = _mm_load_ps(values + row);
+        _mm_store_ps(values + row, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, shift), scale), offset));
+    }
+#endif
+    for (; row < last; row++) {
+        values[row] = (values[row] - map->shift) * map->scale + map->offset;
+    }
+}
+
+// Applies maps to rows [first_row, last_row) of every column, in parallel across columns
+void apply_column_maps(Dataset* ds, const ColumnMap* maps, int first_row, int last_row) {
+    NormalizeJob job = { ds, maps, first_row, last_row };
+    run_parallel(ds->cols, normalize_column_task, &job);
+}
+
+// Derives every column's map into [0, 1] from the statistics gathered while
+// parsing. Constant columns are drawn at 0.5, and the codes of a categorical
+// column are spread evenly over [0, 1] whatever the normalization.
+void compute_column_maps(const Dataset* data, ColumnMap* maps) {
+    // Ranges shared by all axes: the global min and max, and the largest
+    // distance from a column mean in standard deviations
+    float global_min = INFINITY, global_max = -INFINITY;
+    double max_z = 0.0;
+    for (int col = 0; col < data->cols; col++) {
+        ColumnStats* s = &data->stats[col];
+        if (col == data->class_col_index || s->count == 0 || (data->categorical && data->categorical[col])) continue;
+        if (s->min < global_min) global_min = s->min;
+        if (s->max > global_max) global_max = s->max;
+        double mean = s->sum / s->count;
+        double std = sqrt(fmax(s->sum_sq / s->count - mean * mean, 0.0));
+        if (std > 0.0) max_z = fmax(max_z, fmax(mean - s->min, s->max - mean) / std);
+    }
+
+    for (int col = 0; col < data->cols; col++) {
+        ColumnStats* s = &data->stats[col];
+        ColumnMap* map = &maps[col];
+        map->shift = s->count > 0 ? s->min : 0.0f;
+        map->scale = 0.0f;
+        map->offset = 0.5f;
+        if (col == data->class_col_index || s->count == 0) continue;
+
+        if (data->categorical && data->categorical[col]) {
+            map->shift = 0.0f;
+            if (s->max > 0.0f) {
+                map->scale = 1.0f / s->max;
+                map->offset = 0.0f;
+            }
+        } else if (normalization == NORMALIZE_GLOBAL) {
+            if (global_max == global_min) continue;
+            map->shift = global_min;
+            map->scale = 1.0f / (global_max - global_min);
+            map->offset = 0.0f;
+        } else if (s->max == s->min) {
+            continue;
+        } else if (normalization == NORMALIZE_ZSCORE) {
+            // z-scores on a scale shared by all axes, zero in the middle
+            double mean = s->sum / s->count;
+            double std = sqrt(fmax(s->sum_sq / s->count - mean * mean, 0.0));
+            if (std == 0.0 || max_z == 0.0) continue;
+            map->shift = (float)mean;
+            map->scale = (float)(0.5 / (max_z * std));
+        } else {
+            map->scale = 1.0f / (s->max - s->min);
+            map->offset = 0.0f;
+        }
+    }
+}
+
+// Rescales every column into [0, 1] in one pass per column, in parallel across
+// columns, and keeps the maps in data->maps. min_vals and max_vals receive each
+// column's original range. NaN values stay NaN. Out-of-core columns are only
+// mapped as their chunks are read.
+void normalize_data(Dataset* data, float* min_vals, float* max_vals) {
+    int cols = data->cols;
+    if (data->stats == NULL) {
+        data->stats = (ColumnStats*)malloc(cols * sizeof(ColumnStats));
+        if (data->stats == NULL) {
+            perror("Memory allocation failed for column statistics");
+            return;
+        }
+        column_stats_reset(data->stats, cols);
+        for (int col = 0; col < cols; col++) {
+            if (col == data->class_col_index) continue;
+            for (int row = 0; row < data->rows; row++) column_stats_add(&data->stats[col], data->columns[col][row]);
+        }
+    }
+    if (data->maps == NULL) data->maps = (ColumnMap*)malloc(cols * sizeof(ColumnMap));
+    if (data->maps == NULL) {
+        perror("Memory allocation failed for column maps");
+        return;
+    }
+
+    compute_column_maps(data, data->maps);
+    for (int col = 0; col < cols; col++) {
+        min_vals[col] = data->stats[col].count > 0 ? data->stats[col].min : 0.0f;
+        max_vals[col] = data->stats[col].count > 0 ? data->stats[col].max : 0.0f;
+    }
+    if (data->tiles != NULL) data->tiles->maps = data->maps;
+    else apply_column_maps(data, data->maps, 0, data->rows);
+}
+
+// Normalizes rows [first_row, rows), appended to a normalized dataset. They
+// reuse the current maps unless some column's range grew past old_stats; then
+// every column gets a new map and the older rows are moved onto it through the
+// composition of the old map's inverse and the new map. Returns true in that case.
+bool normalize_appended(Dataset* ds, int first_row, const ColumnStats* old_stats) {
+    bool grown = false;
+    for (int col = 0; col < ds->cols && !grown; col++) {
+        if (col == ds->class_col_index) continue;
+        grown = ds->stats[col].min < old_stats[col].min || ds->stats[col].max > old_stats[col].max;
+    }
+    if (!grown) {
+        apply_column_maps(ds, ds->maps, first_row, ds->rows);
+        return false;
+    }
+
+    ColumnMap* maps = (ColumnMap*)malloc(ds->cols * sizeof(ColumnMap));
+    ColumnMap* remaps = (ColumnMap*)malloc(ds->cols * sizeof(ColumnMap));
+    if (maps == NULL || remaps == NULL) {
+        perror("Memory allocation failed for column maps");
+        free(maps);
+        free(remaps);
+        apply_column_maps(ds, ds->maps, first_row, ds->rows);
+        return false;
+    }
+    compute_column_maps(ds, maps);
+    for (int col = 0; col < ds->cols; col++) {
+        const ColumnMap* from = &ds->maps[col];
+        const ColumnMap* to = &maps[col];
+        // A zero scale means every old value was from->shift
+        remaps[col].shift = from->offset;
+        remaps[col].scale = from->scale != 0.0f ? to->scale / from->scale : 0.0f;
+        remaps[col].offset = (from->shift - to->shift) * to->scale + to->offset;
+    }
+    apply_column_maps(ds, remaps, 0, first_row);
+    apply_column_maps(ds, maps, first_row, ds->rows);
+    free(remaps);
+    free(ds->maps);
+    ds->maps = maps;
+    return true;
+}
+
+// Maps a float to an unsigned key with the same ordering; NaN sorts last
+uint32_t float_sort_key(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// Sorts the rows of one column by value with a 4 x 8-bit LSD radix sort
+void sort_column_task(void* ctx, int col) {
+    Dataset* ds = (Dataset*)ctx;
+    if (col == ds->class_col_index) return;
+    int rows = ds->rows;
+
+    int* order = (int*)aligned_malloc((rows > 0 ? rows : 1) * sizeof(int));
+    uint32_t* keys = (uint32_t*)malloc((rows > 0 ? rows : 1) * 2 * sizeof(uint32_t));
+    int* scratch_rows = (int*)malloc((rows > 0 ? rows : 1) * sizeof(int));
+    if (order == NULL || keys == NULL || scratch_rows == NULL) {
+        perror("Memory allocation failed for column sort");
+        aligned_free(order);
+        free(keys);
+        free(scratch_rows);
+        return;
+    }
+
+    uint32_t* src_keys = keys;
+    uint32_t* dst_keys = keys + rows;
+    int* src_rows = order;
+    int* dst_rows = scratch_rows;
+    float block[COLUMN_BLOCK_ROWS];
+    for (int first = 0; first < rows; first += COLUMN_BLOCK_ROWS) {
+        int count = rows - first < COLUMN_BLOCK_ROWS ? rows - first : COLUMN_BLOCK_ROWS;
+        const float* values = column_block(ds, col, first, count, block);
+        for (int i = 0; i < count; i++) {
+            src_keys[first + i] = float_sort_key(values[i]);
+            src_rows[first + i] = first + i;
+        }
+    }
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        size_t offsets[256] = { 0 };
+        for (int i = 0; i < rows; i++) offsets[(src_keys[i] >> shift) & 0xFF]++;
+        size_t total = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t count = offsets[b];
+            offsets[b] = total;
+            total += count;
+        }
+        for (int i = 0; i < rows; i++) {
+            size_t dst = offsets[(src_keys[i] >> shift) & 0xFF]++;
+            dst_keys[dst] = src_keys[i];
+            dst_rows[dst] = src_rows[i];
+        }
+        uint32_t* swap_keys = src_keys; src_keys = dst_keys; dst_keys = swap_keys;
+        int* swap_rows = src_rows; src_rows = dst_rows; dst_rows = swap_rows;
+    }
+    // An even number of passes leaves the result back in order
+
+    free(keys);
+    free(scratch_rows);
+    ds->sorted_rows[col] = order;
+}
+
+// Builds the per-column sort order used by the density engine and range queries
+bool build_sorted_index(Dataset* ds) {
+    if (ds->sorted_rows != NULL) return true;
+    ds->sorted_rows = (int**)calloc(ds->cols, sizeof(int*));
+    if (ds->sorted_rows == NULL) return false;
+    run_parallel(ds->cols, sort_column_task, ds);
+
+    for (int col = 0; col < ds->cols; col++) {
+        if (col != ds->class_col_index && ds->sorted_rows[col] == NULL) return false;
+    }
+    return true;
+}
+
+// Drops the sorted index, e.g. once values changed order; it is rebuilt on demand
+void free_sorted_index(Dataset* ds) {
+    for (int col = 0; ds->sorted_rows && col < ds->cols; col++) {
+        aligned_free(ds->sorted_rows[col]);
+    }
+    free(ds->sorted_rows);
+    ds->sorted_rows = NULL;
+}
+
+typedef struct {
+    Dataset* ds;
+    float* density;
+    uint8_t* levels;  // Compact mode output instead of density
+    float brush_size;
+} DensityJob;
+
+// Counts, for every row, the other rows within brush_size on one column.
+// A sliding window over the sorted values gives the count in O(rows).
+// Levels are the counts scaled to 0..255 by the column maximum, which takes
+// a first window pass to find that maximum.
+void density_column_task(void* ctx, int col) {
+    DensityJob* job = (DensityJob*)ctx;
+    Dataset* ds = job->ds;
+    if (col == ds->class_col_index) return;
+    int rows = ds->rows;
+    const int* order = ds->sorted_rows[col];
+    float* col_density = job->density ? job->density + (size_t)col * rows : NULL;
+    uint8_t* col_levels = job->levels ? job->levels + (size_t)col * rows : NULL;
+    float brush_size = job->brush_size;
+
+    float* sorted = (float*)malloc((rows > 0 ? rows : 1) * sizeof(float));
+    if (sorted == NULL) {
+        perror("Memory allocation failed for density window");
+        return;
+    }
+    for (int k = 0; k < rows; k++) {
+        sorted[k] = dataset_value(ds, col, order[k]);
+    }
+
+    int max_count = 0;
+    for (int pass = col_levels ? 0 : 1; pass < 2; pass++) {
+        float level_scale = max_count > 0 ? 255.0f / max_count : 0.0f;
+        int lo = 0, hi = 0;
+        for (int k = 0; k < rows; k++) {
+            float value = sorted[k];
+            int count = 0;
+            if (!isnan(value)) {
+                // Same predicate as fabs(a - b) < brush_size, applied from each side
+                while (value - sorted[lo] >= brush_size) lo++;
+                if (hi <= k) hi = k + 1;
+                while (hi < rows && sorted[hi] - value < brush_size) hi++;
+                count = hi - lo - 1;
+            }
+            if (pass == 0) {
+                if (count > max_count) max_count = count;
+            } else if (col_levels) {
+                col_levels[order[k]] = (uint8_t)(count * level_scale + 0.5f);
+            } else {
+                col_density[order[k]] = (float)count;
+            }
+        }
+    }
+    free(sorted);
+}
+
+// Densities are stored column-major: density[col * rows + row]
+void calculate_density(Dataset* data, float* density) {
+    double start_time = get_time_seconds();
+
+    // Initialize densities to 0
+    memset(density, 0, sizeof(float) * data->rows * data->cols);
+    if (!build_sorted_index(data)) {
+        fprintf(stderr, "Failed to build the sorted column index.\n");
+        return;
+    }
+
+    DensityJob job = { data, density, NULL, brush_size };
+    run_parallel(data->cols, density_column_task, &job);
+
+    if (DEBUG) {
+        printf("Density with brush size %g took %.3f s\n", brush_size, get_time_seconds() - start_time);
+    }
+}
+
+// Profile bin of a normalized value
+int profile_bin(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    int bin = (int)(value * DENSITY_PROFILE_BINS);
+    return bin < DENSITY_PROFILE_BINS ? bin : DENSITY_PROFILE_BINS - 1;
+}
+
+// Out-of-core density of a value: the rows within brush_size of it on the
+// column, itself included, to the resolution of the profile bins
+float profile_density(const TileStore* store, int col, float value) {
+    if (isnan(value)) return 0.0f;
+    const uint32_t* cumulative = store->profile + (size_t)col * (DENSITY_PROFILE_BINS + 1);
+    return (float)(cumulative[profile_bin(value + brush_size) + 1] - cumulative[profile_bin(value - brush_size)]);
+}
+
+// Alpha scales of the profile densities, one over each column's densest bin
+void update_profile_scales(TileStore* store) {
+    for (int col = 0; col < store->cols; col++) {
+        float max_density = 0.0f;
+        for (int bin = 0; col != store->class_col_index && bin < DENSITY_PROFILE_BINS; bin++) {
+            max_density = fmaxf(max_density, profile_density(store, col, (bin + 0.5f) / DENSITY_PROFILE_BINS));
+        }
+        store->profile_scale[col] = max_density > 0.0f ? 1.0f / max_density : 0.0f;
+    }
+}
+
+// Streams one column through the page cache into its cumulative histogram
+void density_profile_task(void* ctx, int col) {
+    Dataset* ds = (Dataset*)ctx;
+    if (col == ds->class_col_index) return;
+    uint32_t* cumulative = ds->tiles->profile + (size_t)col * (DENSITY_PROFILE_BINS + 1);
+    float block[COLUMN_BLOCK_ROWS];
+    for (int first = 0; first < ds->rows; first += COLUMN_BLOCK_ROWS) {
+        int count = ds->rows - first < COLUMN_BLOCK_ROWS ? ds->rows - first : COLUMN_BLOCK_ROWS;
+        const float* values = column_block(ds, col, first, count, block);
+        for (int i = 0; i < count; i++) {
+            if (!isnan(values[i])) cumulative[profile_bin(values[i]) + 1]++;
+        }
+    }
+    for (int bin = 0; bin < DENSITY_PROFILE_BINS; bin++) cumulative[bin + 1] += cumulative[bin];
+}
+
+// Out-of-core datasets have no per-row densities: one streaming pass per
+// column builds value histograms that answer density queries for any brush
+bool calculate_density_profile(Dataset* ds) {
+    TileStore* store = ds->tiles;
+    store->profile = (uint32_t*)calloc((size_t)ds->cols * (DENSITY_PROFILE_BINS + 1), sizeof(uint32_t));
+    store->profile_scale = (float*)calloc(ds->cols, sizeof(float));
+    if (store->profile == NULL || store->profile_scale == NULL) {
+        perror("Memory allocation failed for density profiles");
+        return false;
+    }
+    run_parallel(ds->cols, density_profile_task, ds);
+    update_profile_scales(store);
+    return true;
+}
+
+typedef struct {
+    Dataset* ds;
+    float* density;
+    int old_rows;          // Rows already counted and indexed
+    float brush_size;
+    bool failed;           // Some column could not be updated
+} DensityAppendJob;
+
+int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Counts the rows appended to one column into the densities and merges them
+// into the column's sort order. Each new value adds one to the old rows in a
+// contiguous range of the sort order, found by binary search; as the ranges
+// move monotonically with the value, one sweep applies all of them.
+void density_append_task(void* ctx, int col) {
+    DensityAppendJob* job = (DensityAppendJob*)ctx;
+    Dataset* ds = job->ds;
+    if (col == ds->class_col_index) return;
+    int rows = ds->rows, old_rows = job->old_rows, added = rows - old_rows;
+    const int* order = ds->sorted_rows[col];
+    float* col_density = job->density + (size_t)col * rows;
+    float brush_size = job->brush_size;
+
+    // New rows sorted by value, key in the high half and row in the low half
+    uint64_t* fresh = (uint64_t*)malloc(added * sizeof(uint64_t));
+    float* values = (float*)malloc(added * sizeof(float));
+    int* ranges = (int*)malloc(added * 2 * sizeof(int));
+    int* merged = (int*)aligned_malloc(rows * sizeof(int));
+    if (fresh == NULL || values == NULL || ranges == NULL || merged == NULL) {
+        perror("Memory allocation failed for density update");
+        free(fresh);
+        free(values);
+        free(ranges);
+        aligned_free(merged);
+        __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+    for (int i = 0; i < added; i++) {
+        fresh[i] = (uint64_t)float_sort_key(dataset_value(ds, col, old_rows + i)) << 32 | (uint32_t)(old_rows + i);
+    }
+    qsort(fresh, added, sizeof(uint64_t), compare_u64);
+    for (int i = 0; i < added; i++) values[i] = dataset_value(ds, col, (int)(uint32_t)fresh[i]);
+
+    // NaN sorts last and counts towards nothing
+    int valid = old_rows, fresh_valid = added;
+    while (valid > 0 && isnan(dataset_value(ds, col, order[valid - 1]))) valid--;
+    while (fresh_valid > 0 && isnan(values[fresh_valid - 1])) fresh_valid--;
+
+    // Old rows within brush_size of each new value, with the predicates of the full window
+    int* lo = ranges;
+    int* hi = ranges + added;
+    for (int i = 0; i < fresh_valid; i++) {
+        float value = values[i];
+        int a = i > 0 ? lo[i - 1] : 0, b = valid;
+        while (a < b) {
+            int mid = a + (b - a) / 2;
+            if (value - dataset_value(ds, col, order[mid]) >= brush_size) a = mid + 1; else b = mid;
+        }
+        lo[i] = a;
+        b = valid;
+        a = i > 0 && hi[i - 1] > lo[i] ? hi[i - 1] : lo[i];
+        while (a < b) {
+            int mid = a + (b - a) / 2;
+            if (dataset_value(ds, col, order[mid]) - value < brush_size) a = mid + 1; else b = mid;
+        }
+        hi[i] = a;
+    }
+
+    // New rows: their old neighbors plus a window over the new values alone
+    for (int i = 0, wlo = 0, whi = 0; i < added; i++) {
+        int row = (int)(uint32_t)fresh[i];
+        if (i >= fresh_valid) {
+            col_density[row] = 0.0f;
+            continue;
+        }
+        while (values[i] - values[wlo] >= brush_size) wlo++;
+        if (whi <= i) whi = i + 1;
+        while (whi < fresh_valid && values[whi] - values[i] < brush_size) whi++;
+        col_density[row] = (float)(hi[i] - lo[i] + whi - wlo - 1);
+    }
+
+    // Old rows: the number of ranges covering their sorted position
+    if (fresh_valid > 0) {
+        int opened = 0, closed = 0;
+        for (int k = lo[0]; k < hi[fresh_valid - 1]; k++) {
+            while (opened < fresh_valid && lo[opened] <= k) opened++;
+            while (closed < fresh_valid && hi[closed] <= k) closed++;
+            col_density[order[k]] += (float)(opened - closed);
+        }
+    }
+
+    // Merge the new rows into the sort order: search where each one goes and
+    // copy the runs of old rows in between, instead of comparing every old key
+    int copied = 0, out = 0;
+    for (int i = 0, a = 0; i < added; i++) {
+        uint32_t key = (uint32_t)(fresh[i] >> 32);
+        int b = old_rows;
+        while (a < b) {
+            int mid = a + (b - a) / 2;
+            if (float_sort_key(dataset_value(ds, col, order[mid])) <= key) a = mid + 1; else b = mid;
+        }
+        memcpy(merged + out, order + copied, (size_t)(a - copied) * sizeof(int));
+        out += a - copied;
+        copied = a;
+        merged[out++] = (int)(uint32_t)fresh[i];
+    }
+    memcpy(merged + out, order + copied, (size_t)(old_rows - copied) * sizeof(int));
+
+    aligned_free(ds->sorted_rows[col]);
+    ds->sorted_rows[col] = merged;
+    free(fresh);
+    free(values);
+    free(ranges);
+}
+
+// Grows the densities from old_rows to ds->rows rows per column and counts the
+// appended rows in, updating the sorted index with them, instead of recomputing
+// everything. Falls back to calculate_density without a sorted index. Returns
+// the reallocated array, or NULL after an allocation failure.
+float* extend_density(Dataset* ds, int old_rows, float* density) {
+    float* grown = (float*)realloc(density, ((size_t)ds->rows * ds->cols > 0 ? (size_t)ds->rows * ds->cols : 1) * sizeof(float));
+    if (grown == NULL) {
+        perror("Memory allocation failed for density");
+        free(density);
+        return NULL;
+    }
+    if (ds->sorted_rows == NULL || density == NULL) {
+        calculate_density(ds, grown);
+        return grown;
+    }
+
+    // Columns move to the new stride back to front, as each only moves forward
+    for (int col = ds->cols - 1; col > 0; col--) {
+        memmove(grown + (size_t)col * ds->rows, grown + (size_t)col * old_rows, (size_t)old_rows * sizeof(float));
+    }
+    DensityAppendJob job = { ds, grown, old_rows, brush_size, false };
+    run_parallel(ds->cols, density_append_task, &job);
+    if (job.failed) {
+        free_sorted_index(ds);
+        calculate_density(ds, grown);
+    }
+    return grown;
+}
+
+// Compact mode densities, one byte per value laid out like calculate_density's
+void calculate_density_levels(Dataset* data, uint8_t* levels) {
+    memset(levels, 0, (size_t)data->rows * data->cols);
+    if (!build_sorted_index(data)) {
+        fprintf(stderr, "Failed to build the sorted column index.\n");
+        return;
+    }
+    DensityJob job = { data, NULL, levels, brush_size };
+    run_parallel(data->cols, density_column_task, &job);
+}
+
+// Scales float densities, e.g. from a cache, down to compact levels
+uint8_t* density_to_levels(Dataset* data, const float* density) {
+    uint8_t* levels = (uint8_t*)calloc((size_t)data->rows * data->cols + 1, 1);
+    if (levels == NULL) return NULL;
+    for (int col = 0; col < data->cols; col++) {
+        const float* col_density = density + (size_t)col * data->rows;
+        float max_density = 0.0f;
+        for (int row = 0; row < data->rows; row++) {
+            if (col_density[row] > max_density) max_density = col_density[row];
+        }
+        float level_scale = max_density > 0.0f ? 255.0f / max_density : 0.0f;
+        for (int row = 0; row < data->rows; row++) {
+            levels[(size_t)col * data->rows + row] = (uint8_t)(col_density[row] * level_scale + 0.5f);
+        }
+    }
+    return levels;
+}
+
+// Restores the heap property below slot i of a min-heap of classes ordered by due
+void sift_down_due(int* heap, int size, const double* due, int i) {
+    for (;;) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && due[heap[left]] < due[heap[smallest]]) smallest = left;
+        if (right < size && due[heap[right]] < due[heap[smallest]]) smallest = right;
+        if (smallest == i) return;
+        int swap = heap[i]; heap[i] = heap[smallest]; heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+// Draw order in which every prefix is a stratified sample of the rows. The
+// first SAMPLE_MIN_PER_CLASS rows of every class come first, round-robin, so
+// rare classes show in any sample; the other rows follow in proportion to
+// their class sizes. Within a class rows are taken at a stride coprime to its
+// size, which spreads every sample over the whole file.
+int* build_sample_order(const Dataset* ds, int num_classes) {
+    int rows = ds->rows, classes = num_classes > 0 ? num_classes : 1;
+    int* order = (int*)malloc((rows > 0 ? rows : 1) * sizeof(int));
+    int* by_class = (int*)malloc((rows > 0 ? rows : 1) * sizeof(int));
+    int* start = (int*)calloc(classes + 1, sizeof(int));
+    int* taken = (int*)calloc(classes, sizeof(int));
+    uint64_t* stride = (uint64_t*)malloc(classes * sizeof(uint64_t));
+    double* due = (double*)malloc(classes * 2 * sizeof(double));
+    int* heap = (int*)malloc(classes * sizeof(int));
+    if (order == NULL || by_class == NULL || start == NULL || taken == NULL || stride == NULL || due == NULL || heap == NULL) {
+        perror("Memory allocation failed for the sample order");
+        free(order);
+        free(by_class);
+        free(start);
+        free(taken);
+        free(stride);
+        free(due);
+        free(heap);
+        return NULL;
+    }
+
+    // Rows grouped by class in file order, then each class's stride
+    for (int row = 0; row < rows; row++) start[ds->class_ids[row] + 1]++;
+    for (int c = 0; c < classes; c++) start[c + 1] += start[c];
+    for (int row = 0; row < rows; row++) {
+        int c = ds->class_ids[row];
+        by_class[start[c] + taken[c]++] = row;
+    }
+    for (int c = 0; c < classes; c++) {
+        uint64_t size = (uint64_t)(start[c + 1] - start[c]);
+        uint64_t s = size > 2 ? (uint64_t)(size * 0.6180339887) : 1;
+        for (;; s++) {
+            uint64_t a = s, b = size;
+            while (b != 0) { uint64_t t = a % b; a = b; b = t; }
+            if (a <= 1) break;
+        }
+        stride[c] = s;
+        taken[c] = 0;
+    }
+
+    int out = 0;
+    for (int j = 0; j < SAMPLE_MIN_PER_CLASS; j++) {
+        for (int c = 0; c < classes; c++) {
+            int size = start[c + 1] - start[c];
+            if (j >= size) continue;
+            order[out++] = by_class[start[c] + (int)((uint64_t)j * stride[c] % size)];
+            taken[c]++;
+        }
+    }
+
+    // The k-th of the r remaining rows of a class is due at (k + 0.5) / r;
+    // due[c] is the next due time and due[classes + c] the step 1 / r
+    int heap_size = 0;
+    for (int c = 0; c < classes; c++) {
+        int remaining = start[c + 1] - start[c] - taken[c];
+        if (remaining == 0) continue;
+        due[classes + c] = 1.0 / remaining;
+        due[c] = 0.5 * due[classes + c];
+        heap[heap_size++] = c;
+    }
+    for (int i = heap_size / 2 - 1; i >= 0; i--) sift_down_due(heap, heap_size, due, i);
+    while (heap_size > 0) {
+        int c = heap[0], size = start[c + 1] - start[c];
+        order[out++] = by_class[start[c] + (int)((uint64_t)taken[c] * stride[c] % size)];
+        if (++taken[c] == size) {
+            heap[0] = heap[--heap_size];
+        } else {
+            due[c] += due[classes + c];
+        }
+        sift_down_due(heap, heap_size, due, 0);
+    }
+
+    free(by_class);
+    free(start);
+    free(taken);
+    free(stride);
+    free(due);
+    free(heap);
+    return order;
+}
+
+// Binary cache written next to the CSV (<csv>.cvcache) after a full load. Every
+// section starts on a COLUMN_ALIGNMENT boundary so a mapped cache is used in place.
+#define CACHE_MAGIC "CVCACHE1"
+#define CACHE_VERSION 3
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t source_size;  // Source CSV size, mtime and sampled hash
+    int64_t source_mtime;
+    uint64_t source_hash;
+    int32_t rows;
+    int32_t cols;
+    int32_t class_col_index;
+    int32_t num_classes;
+    int32_t normalization; // Normalization of the stored columns
+    float brush_size;      // Brush the stored densities were computed with
+    int32_t num_categories; // Labels of all categorical columns together
+    uint32_t names_size;
+    uint64_t column_stride; // Bytes between consecutive columns
+    uint64_t min_max_offset;   // float min_vals[cols], then max_vals[cols]
+    uint64_t class_ids_offset; // int32 class_ids[rows]
+    uint64_t columns_offset;   // Normalized columns, the class column slot left empty
+    uint64_t density_offset;   // density[col * rows + row]
+    uint64_t classes_offset;   // CacheClass[num_classes]
+    uint64_t categories_offset; // CacheCategory[num_categories], by column and code
+    uint64_t names_offset;     // NUL-terminated class names, then category labels
+    uint64_t total_size;
+} CacheHeader;
+
+typedef struct {
+    float r, g, b;
+    uint32_t name_offset;  // From names_offset
+} CacheClass;
+
+typedef struct {
+    int32_t col;           // Categorical column of the label
+    uint32_t name_offset;  // From names_offset
+} CacheCategory;
+
+// True when the densities in use point into a mapped cache and must not be freed
+bool density_in_cache = false;
+
+uint64_t align_offset(uint64_t offset) {
+    return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+}
+
+bool get_file_stamp(const char* filename, uint64_t* size, int64_t* mtime) {
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_stat64(filename, &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0) return false;
+#endif
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// FNV-1a over the first and last 64 KB and 64 evenly spread 4 KB samples, so
+// validating a multi-GB source stays cheap while edits of the same size and
+// mtime are still likely to be caught
+uint64_t hash_source_file(const char* filename) {
+    MappedFile mf;
+    if (!map_file(filename, &mf, false)) return 0;
+    uint64_t hash = 14695981039346656037ull;
+    size_t block = 4096, edge = 65536;
+    for (int sample = -1; sample <= 64; sample++) {
+        size_t start, length;
+        if (sample < 0) {
+            start = 0;
+            length = edge;
+        } else if (sample == 64) {
+            start = mf.size > edge ? mf.size - edge : 0;
+            length = edge;
+        } else {
+            start = (size_t)((double)mf.size * sample / 64.0);
+            length = block;
+        }
+        if (start > mf.size) start = mf.size;
+        if (length > mf.size - start) length = mf.size - start;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (unsigned char)mf.data[start + i];
+            hash *= 1099511628211ull;
+        }
+    }
+    unmap_file(&mf);
+    return hash;
+}
+
+// Whether count items of size bytes at offset lie within the cache file and
+// start on a float boundary, without overflowing
+bool cache_section_fits(const CacheHeader* header, uint64_t offset, uint64_t count, uint64_t size) {
+    if (offset % sizeof(float) != 0 || offset > header->total_size) return false;
+    return count == 0 || count <= (header->total_size - offset) / size;
+}
+
+char* cache_filename(const char* csv_file) {
+    char* filename = (char*)malloc(strlen(csv_file) + 9);
+    if (filename != NULL) sprintf(filename, "%s.cvcache", csv_file);
+    return filename;
+}
+
+// Writes count bytes at offset, zero padding the gap from the current position
+bool write_section(FILE* file, uint64_t* position, uint64_t offset, const void* data, size_t count) {
+    char padding[COLUMN_ALIGNMENT] = { 0 };
+    while (*position < offset) {
+        size_t gap = offset - *position < COLUMN_ALIGNMENT ? (size_t)(offset - *position) : COLUMN_ALIGNMENT;
+        if (fwrite(padding, 1, gap, file) != gap) return false;
+        *position += gap;
+    }
+    if (count > 0 && fwrite(data, 1, count, file) != count) return false;
+    *position += count;
+    return true;
+}
+
+// Saves the normalized dataset, its classes, min/max and densities next to the CSV.
+// The cache is written under a temporary name and renamed, so readers never see half a file.
+bool write_cache(const char* csv_file, Dataset* ds, ClassDict* classes, const float* min_vals, const float* max_vals, const float* density) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.version = CACHE_VERSION;
+    header.header_size = sizeof(CacheHeader);
+    if (!get_file_stamp(csv_file, &header.source_size, &header.source_mtime)) return false;
+    header.source_hash = hash_source_file(csv_file);
+    header.rows = ds->rows;
+    header.cols = ds->cols;
+    header.class_col_index = ds->class_col_index;
+    header.num_classes = classes->num_classes;
+    header.normalization = normalization;
+    header.brush_size = brush_size;
+
+    CacheClass* class_table = (CacheClass*)calloc(classes->num_classes > 0 ? classes->num_classes : 1, sizeof(CacheClass));
+    if (class_table == NULL) return false;
+    for (int i = 0; i < classes->num_classes; i++) {
+        class_table[i].r = classes->class_info[i].r;
+        class_table[i].g = classes->class_info[i].g;
+        class_table[i].b = classes->class_info[i].b;
+        class_table[i].name_offset = header.names_size;
+        header.names_size += (uint32_t)strlen(classes->class_info[i].class_name) + 1;
+    }
+    for (int col = 0; ds->categorical && col < ds->cols; col++) {
+        if (ds->categorical[col]) header.num_categories += ds->categories[col].num_classes;
+    }
+    CacheCategory* category_table = (CacheCategory*)calloc(header.num_categories > 0 ? header.num_categories : 1, sizeof(CacheCategory));
+    if (category_table == NULL) {
+        free(class_table);
+        return false;
+    }
+    for (int col = 0, i = 0; ds->categorical && col < ds->cols; col++) {
+        if (!ds->categorical[col]) continue;
+        for (int k = 0; k < ds->categories[col].num_classes; k++, i++) {
+            category_table[i].col = col;
+            category_table[i].name_offset = header.names_size;
+            header.names_size += (uint32_t)strlen(ds->categories[col].class_info[k].class_name) + 1;
+        }
+    }
+
+    uint64_t rows = (uint64_t)ds->rows, cols = (uint64_t)ds->cols;
+    header.column_stride = align_offset(rows * sizeof(float));
+    header.min_max_offset = align_offset(sizeof(CacheHeader));
+    header.class_ids_offset = align_offset(header.min_max_offset + 2 * cols * sizeof(float));
+    header.columns_offset = align_offset(header.class_ids_offset + rows * sizeof(int32_t));
+    header.density_offset = header.columns_offset + cols * header.column_stride;
+    header.classes_offset = align_offset(header.density_offset + rows * cols * sizeof(float));
+    header.categories_offset = header.classes_offset + (uint64_t)classes->num_classes * sizeof(CacheClass);
+    header.names_offset = header.categories_offset + (uint64_t)header.num_categories * sizeof(CacheCategory);
+    header.total_size = header.names_offset + header.names_size;
+
+    char* filename = cache_filename(csv_file);
+    char* temp_name = filename ? (char*)malloc(strlen(filename) + 5) : NULL;
+    FILE* file = NULL;
+    if (temp_name != NULL) {
+        sprintf(temp_name, "%s.tmp", filename);
+        file = fopen(temp_name, "wb");
+    }
+    bool ok = file != NULL;
+    uint64_t position = 0;
+    ok = ok && write_section(file, &position, 0, &header, sizeof(header));
+    ok = ok && write_section(file, &position, header.min_max_offset, min_vals, cols * sizeof(float));
+    ok = ok && write_section(file, &position, position, max_vals, cols * sizeof(float));
+    ok = ok && write_section(file, &position, header.class_ids_offset, ds->class_ids, rows * sizeof(int32_t));
+    for (int col = 0; col < ds->cols && ok; col++) {
+        if (col == ds->class_col_index) continue;
+        ok = write_section(file, &position, header.columns_offset + col * header.column_stride, ds->columns[col], rows * sizeof(float));
+    }
+    ok = ok && write_section(file, &position, header.density_offset, density, rows * cols * sizeof(float));
+    ok = ok && write_section(file, &position, header.classes_offset, class_table, (size_t)classes->num_classes * sizeof(CacheClass));
+    ok = ok && write_section(file, &position, header.categories_offset, category_table, (size_t)header.num_categories * sizeof(CacheCategory));
+    for (int i = 0; i < classes->num_classes && ok; i++) {
+        ok = write_section(file, &position, position, classes->class_info[i].class_name, strlen(classes->class_info[i].class_name) + 1);
+    }
+    for (int col = 0; ds->categorical && col < ds->cols && ok; col++) {
+        if (!ds->categorical[col]) continue;
+        for (int k = 0; k < ds->categories[col].num_classes && ok; k++) {
+            const char* label = ds->categories[col].class_info[k].class_name;
+            ok = write_section(file, &position, position, label, strlen(label) + 1);
+        }
+    }
+    if (file != NULL && fclose(file) != 0) ok = false;
+
+    if (ok) {
+#ifdef _WIN32
+        remove(filename); // rename does not replace existing files on Windows
+#endif
+        ok = rename(temp_name, filename) == 0;
+    } else if (temp_name != NULL) {
+        remove(temp_name);
+    }
+    if (!ok) fprintf(stderr, "Could not write the cache file %s.\n", filename ? filename : csv_file);
+    free(class_table);
+    free(category_table);
+    free(filename);
+    free(temp_name);
+    return ok;
+}
+
+// Opens the cache of csv_file when it matches the source, pointing the dataset
+// and the densities straight into the copy-on-write mapping. min/max are copied out.
+Dataset* load_cache(const char* csv_file, ClassDict* classes, float** min_vals, float** max_vals, float** densities) {
+    double start_time = get_time_seconds();
+    uint64_t source_size, cache_size;
+    int64_t source_mtime, cache_mtime;
+    char* filename = cache_filename(csv_file);
+    if (filename == NULL || !get_file_stamp(csv_file, &source_size, &source_mtime) ||
+        !get_file_stamp(filename, &cache_size, &cache_mtime)) {
+        free(filename);
+        return NULL;
+    }
+
+    MappedFile* mf = (MappedFile*)malloc(sizeof(MappedFile));
+    if (mf == NULL || !map_file(filename, mf, true)) {
+        free(mf);
+        free(filename);
+        return NULL;
+    }
+    free(filename);
+
+    const CacheHeader* header = (const CacheHeader*)mf->data;
+    bool valid = mf->size >= sizeof(CacheHeader) && memcmp(header->magic, CACHE_MAGIC, 8) == 0 &&
+                 header->version == CACHE_VERSION && header->header_size == sizeof(CacheHeader) &&
+                 header->total_size == mf->size && header->source_size == source_size &&
+                 header->source_mtime == source_mtime && header->normalization == (int32_t)normalization &&
+                 header->rows >= 0 && header->cols > 0 && header->num_classes >= 0 && header->num_categories >= 0 &&
+                 header->class_col_index >= 0 && header->class_col_index < header->cols &&
+                 header->names_offset <= header->total_size &&
+                 header->names_offset + header->names_size == header->total_size &&
+                 (header->names_size == 0 || mf->data[header->total_size - 1] == '\0');
+    // Every section must lie within the file, columns must not overlap
+    uint64_t rows = valid ? (uint64_t)header->rows : 0, cols = valid ? (uint64_t)header->cols : 0;
+    valid = valid && header->column_stride >= rows * sizeof(float) &&
+            cache_section_fits(header, header->min_max_offset, 2 * cols, sizeof(float)) &&
+            cache_section_fits(header, header->class_ids_offset, rows, sizeof(int32_t)) &&
+            (header->column_stride == 0 || cache_section_fits(header, header->columns_offset, cols, header->column_stride)) &&
+            cache_section_fits(header, header->density_offset, rows * cols, sizeof(float)) &&
+            cache_section_fits(header, header->classes_offset, (uint64_t)header->num_classes, sizeof(CacheClass)) &&
+            cache_section_fits(header, header->categories_offset, (uint64_t)header->num_categories, sizeof(CacheCategory));
+    valid = valid && header->source_hash == hash_source_file(csv_file);
+    if (!valid) {
+        unmap_file(mf);
+        free(mf);
+        return NULL;
+    }
+
+    Dataset* ds = (Dataset*)calloc(1, sizeof(Dataset));
+    *min_vals = (float*)malloc(header->cols * sizeof(float));
+    *max_vals = (float*)malloc(header->cols * sizeof(float));
+    if (ds != NULL) ds->columns = (float**)calloc(header->cols, sizeof(float*));
+    if (ds == NULL || ds->columns == NULL || *min_vals == NULL || *max_vals == NULL) {
+        perror("Memory allocation failed for cached dataset");
+        if (ds) free(ds->columns);
+        free(ds);
+        free(*min_vals);
+        free(*max_vals);
+        unmap_file(mf);
+        free(mf);
+        return NULL;
+    }
+
+    char* base = (char*)mf->data;
+    ds->rows = header->rows;
+    ds->cols = header->cols;
+    ds->class_col_index = header->class_col_index;
+    ds->capacity = (size_t)header->rows;
+    ds->mapping = mf;
+    ds->arrays_mapped = true;
+    ds->class_ids = (int*)(base + header->class_ids_offset);
+    for (int col = 0; col < ds->cols; col++) {
+        if (col != ds->class_col_index) ds->columns[col] = (float*)(base + header->columns_offset + col * header->column_stride);
+    }
+    memcpy(*min_vals, base + header->min_max_offset, header->cols * sizeof(float));
+    memcpy(*max_vals, base + header->min_max_offset + header->cols * sizeof(float), header->cols * sizeof(float));
+
+    // Densities are only valid for the brush they were computed with
+    *densities = header->brush_size == brush_size ? (float*)(base + header->density_offset) : NULL;
+
+    // Rebuild the class dictionary in its original order, keeping the stored colors
+    memset(classes, 0, sizeof(ClassDict));
+    const CacheClass* class_table = (const CacheClass*)(base + header->classes_offset);
+    for (int i = 0; i < header->num_classes; i++) {
+        if (class_table[i].name_offset >= header->names_size ||
+            get_class_index(classes, base + header->names_offset + class_table[i].name_offset) != i) {
+            fprintf(stderr, "Corrupt class table in the cache file.\n");
+            class_dict_free(classes);
+            free(*min_vals);
+            free(*max_vals);
+            dataset_free(ds);
+            return NULL;
+        }
+        classes->class_info[i].r = class_table[i].r;
+        classes->class_info[i].g = class_table[i].g;
+        classes->class_info[i].b = class_table[i].b;
+    }
+    for (int row = 0; row < ds->rows; row++) {
+        if (ds->class_ids[row] < 0 || ds->class_ids[row] >= header->num_classes) {
+            fprintf(stderr, "Corrupt class ids in the cache file.\n");
+            class_dict_free(classes);
+            free(*min_vals);
+            free(*max_vals);
+            dataset_free(ds);
+            return NULL;
+        }
+    }
+
+    // Category labels are stored by column in code order, so interning them
+    // again gives back the stored codes
+    const CacheCategory* category_table = (const CacheCategory*)(base + header->categories_offset);
+    if (header->num_categories > 0) {
+        ds->categorical = (bool*)calloc(ds->cols, sizeof(bool));
+        ds->categories = (ClassDict*)calloc(ds->cols, sizeof(ClassDict));
+    }
+    for (int i = 0; i < header->num_categories; i++) {
+        int col = category_table[i].col;
+        if (ds->categorical == NULL || ds->categories == NULL || col < 0 || col >= ds->cols || col == ds->class_col_index ||
+            category_table[i].name_offset >= header->names_size ||
+            get_class_index(&ds->categories[col], base + header->names_offset + category_table[i].name_offset) != ds->categories[col].num_classes - 1 ||
+            ds->categories[col].num_classes == 0) {
+            fprintf(stderr, "Corrupt category table in the cache file.\n");
+            class_dict_free(classes);
+            free(*min_vals);
+            free(*max_vals);
+            dataset_free(ds);
+            return NULL;
+        }
+        ds->categorical[col] = true;
+    }
+
+    double elapsed = get_time_seconds() - start_time;
+    printf("Opened cached %d rows x %d columns in %.3f s\n", ds->rows, ds->cols, elapsed);
+    return ds;
+}
+
+void free_selection(Selection* selection) {
+    free(selection->bits);
+    free(selection->class_counts);
+    memset(selection, 0, sizeof(Selection));
+}
+
+// Clears the selection, resizing it for the given rows and classes
+bool reset_selection(Selection* selection, int rows, int num_classes) {
+    size_t words = ((size_t)rows + 63) / 64;
+    if (selection->rows != rows || selection->num_classes != num_classes || selection->bits == NULL) {
+        free_selection(selection);
+        selection->bits = (uint64_t*)malloc((words > 0 ? words : 1) * sizeof(uint64_t));
+        selection->class_counts = (int*)malloc((num_classes > 0 ? num_classes : 1) * sizeof(int));
+        if (selection->bits == NULL || selection->class_counts == NULL) {
+            free_selection(selection);
+            return false;
+        }
+        selection->rows = rows;
+        selection->num_classes = num_classes;
+    }
+    memset(selection->bits, 0, (words > 0 ? words : 1) * sizeof(uint64_t));
+    memset(selection->class_counts, 0, (num_classes > 0 ? num_classes : 1) * sizeof(int));
+    selection->selected = 0;
+    return true;
+}
+
+// Tallies the selected rows per class from the bitmask, a row block at a
+// time; class ids are only read for blocks with some row selected
+void count_selection(Selection* selection, const Dataset* ds) {
+    memset(selection->class_counts, 0, (selection->num_classes > 0 ? selection->num_classes : 1) * sizeof(int));
+    selection->selected = 0;
+    int scratch[COLUMN_BLOCK_ROWS];
+    for (int first = 0; first < selection->rows; first += COLUMN_BLOCK_ROWS) {
+        int count = selection->rows - first < COLUMN_BLOCK_ROWS ? selection->rows - first : COLUMN_BLOCK_ROWS;
+        const uint64_t* bits = selection->bits + first / 64;
+        int words = (count + 63) / 64;
+        bool any = false;
+        for (int w = 0; w < words && !any; w++) any = bits[w] != 0;
+        if (!any) continue;
+        const int* class_ids = class_block(ds, first, count, scratch);
+        for (int w = 0; w < words; w++) {
+            uint64_t word = bits[w];
+            while (word) {
+                selection->class_counts[class_ids[w * 64 + __builtin_ctzll(word)]]++;
+                selection->selected++;
+                word &= word - 1;
+            }
+        }
+    }
+}
+
+// Displayed height of a segment at parameter t is c0 + ca * left + cb * right,
+// with axis inversion folded into the coefficients. A segment crosses the box
+// when its heights at the clipped ends t_lo and t_hi straddle [y_lo, y_hi].
+typedef struct {
+    float c0_lo, ca_lo, cb_lo;
+    float c0_hi, ca_hi, cb_hi;
+    float y_lo, y_hi;
+} SegmentBoxTest;
+
+// Tests n segments, setting hits[i] to 1 for those crossing the box
+void segment_box_kernel(const SegmentBoxTest* test, const float* left, const float* right, int n, uint8_t* hits) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 c0_lo = _mm_set1_ps(test->c0_lo), ca_lo = _mm_set1_ps(test->ca_lo), cb_lo = _mm_set1_ps(test->cb_lo);
+    __m128 c0_hi = _mm_set1_ps(test->c0_hi), ca_hi = _mm_set1_ps(test->ca_hi), cb_hi = _mm_set1_ps(test->cb_hi);
+    __m128 y_lo = _mm_set1_ps(test->y_lo), y_hi = _mm_set1_ps(test->y_hi);
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(left + i);
+        __m128 b = _mm_loadu_ps(right + i);
+        __m128 h_lo = _mm_add_ps(c0_lo, _mm_add_ps(_mm_mul_ps(ca_lo, a), _mm_mul_ps(cb_lo, b)));
+        __m128 h_hi = _mm_add_ps(c0_hi, _mm_add_ps(_mm_mul_ps(ca_hi, a), _mm_mul_ps(cb_hi, b)));
+        // NaN heights fail both comparisons, so rows with missing values never match
+        __m128 hit = _mm_and_ps(_mm_cmple_ps(_mm_min_ps(h_lo, h_hi), y_hi), _mm_cmpge_ps(_mm_max_ps(h_lo, h_hi), y_lo));
+        int mask = _mm_movemask_ps(hit);
+        hits[i] = mask & 1;
+        hits[i + 1] = (mask >> 1) & 1;
+        hits[i + 2] = (mask >> 2) & 1;
+        hits[i + 3] = (mask >> 3) & 1;
+    }
+#endif
+    for (; i < n; i++) {
+        // Same association as the SIMD path, so a row tests the same in either
+        float h_lo = test->c0_lo + (test->ca_lo * left[i] + test->cb_lo * right[i]);
+        float h_hi = test->c0_hi + (test->ca_hi * left[i] + test->cb_hi * right[i]);
+        hits[i] = fminf(h_lo, h_hi) <= test->y_hi && fmaxf(h_lo, h_hi) >= test->y_lo;
+    }
+}
+
+typedef struct {
+    const SegmentBoxTest* test;
+    const Dataset* ds;
+    int left_col, right_col;
+    uint64_t* bits;
+} BrushScanJob;
+
+// Rows handled per full-scan task, a multiple of 64 so tasks own whole words
+#define BRUSH_BLOCK_ROWS (64 * 1024)
+
+void brush_scan_task(void* ctx, int task) {
+    BrushScanJob* job = (BrushScanJob*)ctx;
+    int first = task * BRUSH_BLOCK_ROWS;
+    int rows = job->ds->rows;
+    int n = rows - first < BRUSH_BLOCK_ROWS ? rows - first : BRUSH_BLOCK_ROWS;
+    uint8_t hits[1024];
+    float left_block[1024], right_block[1024];
+    for (int done = 0; done < n; done += 1024) {
+        int count = n - done < 1024 ? n - done : 1024;
+        const float* left = column_block(job->ds, job->left_col, first + done, count, left_block);
+        const float* right = column_block(job->ds, job->right_col, first + done, count, right_block);
+        segment_box_kernel(job->test, left, right, count, hits);
+        for (int i = 0; i < count; i++) {
+            int row = first + done + i;
+            job->bits[row >> 6] |= (uint64_t)hits[i] << (row & 63);
+        }
+    }
+}
+
+// Index range [*first, *last) of sorted positions whose displayed value lies in [lo, hi]
+void sorted_range(Dataset* ds, int col, float lo, float hi, int* first, int* last) {
+    const int* order = ds->sorted_rows[col];
+    lo -= 1e-6f; // Slack for rounding in the callers' bounds
+    hi += 1e-6f;
+    if (axis_inverted[col]) {
+        float swap = 1.0f - lo;
+        lo = 1.0f - hi;
+        hi = swap;
+    }
+
+    // NaN values sort last and belong to no range
+    int valid = ds->rows;
+    for (int l = 0, h = ds->rows; l < h; ) {
+        int mid = l + (h - l) / 2;
+        if (isnan(dataset_value(ds, col, order[mid]))) h = valid = mid; else l = mid + 1;
+    }
+    int l = 0, h = valid;
+    while (l < h) {
+        int mid = l + (h - l) / 2;
+        if (dataset_value(ds, col, order[mid]) < lo) l = mid + 1; else h = mid;
+    }
+    *first = l;
+    h = valid;
+    while (l < h) {
+        int mid = l + (h - l) / 2;
+        if (dataset_value(ds, col, order[mid]) <= hi) l = mid + 1; else h = mid;
+    }
+    *last = l;
+}
+
+// Sets up the crossing test of the segments between left_col and col against
+// the box, with t_lo and t_hi the box's horizontal extent within the gap.
+// False when the box misses the gap.
+bool gap_box_test(Dataset* ds, int left_col, int col, float x0, float y0, float x1, float y1,
+                  SegmentBoxTest* test, float* t_lo, float* t_hi) {
+    float xa = left_col / (float)(ds->cols - 1);
+    float xb = col / (float)(ds->cols - 1);
+    float xl = fmaxf(xa, x0), xr = fminf(xb, x1);
+    if (xl > xr) return false;
+    *t_lo = (xl - xa) / (xb - xa);
+    *t_hi = (xr - xa) / (xb - xa);
+
+    float alpha_a = axis_inverted[left_col] ? 1.0f : 0.0f, beta_a = axis_inverted[left_col] ? -1.0f : 1.0f;
+    float alpha_b = axis_inverted[col] ? 1.0f : 0.0f, beta_b = axis_inverted[col] ? -1.0f : 1.0f;
+    SegmentBoxTest box_test = {
+        (1.0f - *t_lo) * alpha_a + *t_lo * alpha_b, (1.0f - *t_lo) * beta_a, *t_lo * beta_b,
+        (1.0f - *t_hi) * alpha_a + *t_hi * alpha_b, (1.0f - *t_hi) * beta_a, *t_hi * beta_b,
+        y0, y1
+    };
+    *test = box_test;
+    return true;
+}
+
+// Finds the sorted positions [*first, *first + count) of the rows that can
+// cross a box spanning [t_lo, t_hi] of the gap, in the sorted index of the
+// left column if *use_left, else of the right one; returns count
+int gap_candidates(Dataset* ds, int left_col, int col, float y0, float y1, float t_lo, float t_hi, int* first, bool* use_left) {
+    // With displayed values in [0, 1], a crossing needs the left value in
+    // [(y0 - t_hi) / (1 - t_hi), y1 / (1 - t_hi)] and the right value in
+    // [(y0 - 1 + t_lo) / t_lo, y1 / t_lo]; take the narrower candidate set
+    int first_a = 0, last_a = ds->rows, first_b = 0, last_b = ds->rows;
+    if (t_hi < 1.0f) sorted_range(ds, left_col, (y0 - t_hi) / (1.0f - t_hi), y1 / (1.0f - t_hi), &first_a, &last_a);
+    if (t_lo > 0.0f) sorted_range(ds, col, (y0 - 1.0f + t_lo) / t_lo, y1 / t_lo, &first_b, &last_b);
+    *use_left = last_a - first_a <= last_b - first_b;
+    *first = *use_left ? first_a : first_b;
+    return *use_left ? last_a - first_a : last_b - first_b;
+}
+
+// Rows mark_box_rows will touch for a box: its candidates, or every row for
+// gaps it has to scan. Only costs binary searches.
+size_t box_cost(Dataset* ds, float x0, float y0, float x1, float y1) {
+    size_t cost = 0;
+    int previous = -1;
+    for (int col = 0; col < ds->cols; col++) {
+        if (col == ds->class_col_index) continue;
+        int left_col = previous;
+        previous = col;
+        SegmentBoxTest test;
+        float t_lo, t_hi;
+        if (left_col < 0 || !gap_box_test(ds, left_col, col, x0, y0, x1, y1, &test, &t_lo, &t_hi)) continue;
+        int first;
+        bool use_left;
+        int count = gap_candidates(ds, left_col, col, y0, y1, t_lo, t_hi, &first, &use_left);
+        cost += count > ds->rows / 4 ? (size_t)ds->rows : (size_t)count;
+    }
+    return cost;
+}
+
+// Sets the bits of the rows whose polyline crosses the box [x0, x1] x [y0, y1],
+// given in unstretched world coordinates, using exact segment versus rectangle
+// tests. Per axis sorted indices narrow each gap to the rows that can reach the
+// box; when they do not narrow enough the gap is scanned with SIMD instead.
+// Out-of-core datasets have no sorted index and stream every gap the box reaches.
+bool mark_box_rows(Dataset* ds, float x0, float y0, float x1, float y1, uint64_t* bits) {
+    bool indexed = ds->tiles == NULL;
+    if (indexed && !build_sorted_index(ds)) return false;
+    if (x0 > x1) { float swap = x0; x0 = x1; x1 = swap; }
+    if (y0 > y1) { float swap = y0; y0 = y1; y1 = swap; }
+
+    float* gathered = NULL;
+    uint8_t* hits = NULL;
+    int previous = -1;
+    for (int col = 0; col < ds->cols; col++) {
+        if (col == ds->class_col_index) continue;
+        int left_col = previous;
+        previous = col;
+        if (left_col < 0) continue;
+
+        SegmentBoxTest test;
+        float t_lo, t_hi;
+        if (!gap_box_test(ds, left_col, col, x0, y0, x1, y1, &test, &t_lo, &t_hi)) continue;
+
+        int first = 0;
+        bool use_left = true;
+        int count = indexed ? gap_candidates(ds, left_col, col, y0, y1, t_lo, t_hi, &first, &use_left) : ds->rows;
+        if (count > ds->rows / 4) {
+            BrushScanJob job = { &test, ds, left_col, col, bits };
+            run_parallel((ds->rows + BRUSH_BLOCK_ROWS - 1) / BRUSH_BLOCK_ROWS, brush_scan_task, &job);
+            continue;
+        }
+        if (count == 0) continue;
+
+        // Gather the candidates into contiguous arrays and test them in one pass
+        const int* candidates = ds->sorted_rows[use_left ? left_col : col] + first;
+        float* new_gathered = (float*)realloc(gathered, (size_t)count * 2 * sizeof(float));
+        uint8_t* new_hits = (uint8_t*)realloc(hits, count);
+        if (new_gathered) gathered = new_gathered;
+        if (new_hits) hits = new_hits;
+        if (new_gathered == NULL || new_hits == NULL) {
+            perror("Memory allocation failed for brush candidates");
+            free(gathered);
+            free(hits);
+            return false;
+        }
+        for (int k = 0; k < count; k++) {
+            gathered[k] = dataset_value(ds, left_col, candidates[k]);
+            gathered[count + k] = dataset_value(ds, col, candidates[k]);
+        }
+        segment_box_kernel(&test, gathered, gathered + count, count, hits);
+        for (int k = 0; k < count; k++) {
+            if (hits[k]) bits[candidates[k] >> 6] |= 1ull << (candidates[k] & 63);
+        }
+    }
+    free(gathered);
+    free(hits);
+    return true;
+}
+
+// Selects the rows whose polyline crosses the box, see mark_box_rows
+bool brush_box(Dataset* ds, float x0, float y0, float x1, float y1, Selection* selection) {
+    if (!reset_selection(selection, ds->rows, num_classes) || !mark_box_rows(ds, x0, y0, x1, y1, selection->bits)) return false;
+    count_selection(selection, ds);
+    return true;
+}
+
+// Writes the parts of box a outside box b as up to four boxes, returns how many
+int box_difference(const float* a, const float* b, float out[][4]) {
+    if (b[2] < a[0] || b[0] > a[2] || b[3] < a[1] || b[1] > a[3]) {
+        memcpy(out[0], a, 4 * sizeof(float));
+        return 1;
+    }
+    int n = 0;
+    float mid_x0 = fmaxf(a[0], b[0]), mid_x1 = fminf(a[2], b[2]);
+    if (a[0] < b[0]) { out[n][0] = a[0]; out[n][1] = a[1]; out[n][2] = b[0]; out[n][3] = a[3]; n++; }
+    if (b[2] < a[2]) { out[n][0] = b[2]; out[n][1] = a[1]; out[n][2] = a[2]; out[n][3] = a[3]; n++; }
+    if (a[1] < b[1]) { out[n][0] = mid_x0; out[n][1] = a[1]; out[n][2] = mid_x1; out[n][3] = b[1]; n++; }
+    if (b[3] < a[3]) { out[n][0] = mid_x0; out[n][1] = b[3]; out[n][2] = mid_x1; out[n][3] = a[3]; n++; }
+    return n;
+}
+
+// Moves a brush to a new box. A row can only change membership when its
+// polyline crosses a part of one box outside the other, so only the rows the
+// sorted indices find in those strips are tested against the new box. Strips
+// the indices cannot narrow, away from the axes, make a fresh brush cheaper.
+bool move_brush(Dataset* ds, Brush* brush, float x0, float y0, float x1, float y1) {
+    if (x0 > x1) { float swap = x0; x0 = x1; x1 = swap; }
+    if (y0 > y1) { float swap = y0; y0 = y1; y1 = swap; }
+    float old_box[4] = { brush->x0, brush->y0, brush->x1, brush->y1 };
+    float new_box[4] = { x0, y0, x1, y1 };
+    brush->x0 = x0; brush->y0 = y0; brush->x1 = x1; brush->y1 = y1;
+    if (brush->rows.bits == NULL || brush->rows.rows != ds->rows || ds->tiles != NULL || !build_sorted_index(ds)) {
+        return brush_box(ds, x0, y0, x1, y1, &brush->rows);
+    }
+
+    float strips[8][4];
+    int num_strips = box_difference(new_box, old_box, strips);
+    num_strips += box_difference(old_box, new_box, strips + num_strips);
+    size_t strip_cost = 0;
+    for (int s = 0; s < num_strips; s++) strip_cost += box_cost(ds, strips[s][0], strips[s][1], strips[s][2], strips[s][3]);
+    if (strip_cost >= box_cost(ds, x0, y0, x1, y1)) return brush_box(ds, x0, y0, x1, y1, &brush->rows);
+
+    size_t words = ((size_t)ds->rows + 63) / 64;
+    uint64_t* touched = (uint64_t*)calloc(words > 0 ? words : 1, sizeof(uint64_t));
+    if (touched == NULL) {
+        perror("Memory allocation failed for brush strips");
+        return false;
+    }
+    for (int s = 0; s < num_strips; s++) {
+        if (!mark_box_rows(ds, strips[s][0], strips[s][1], strips[s][2], strips[s][3], touched)) {
+            free(touched);
+            return false;
+        }
+    }
+    int count = 0;
+    for (size_t w = 0; w < words; w++) count += __builtin_popcountll(touched[w]);
+    if (count > ds->rows / 4) {
+        free(touched);
+        return brush_box(ds, x0, y0, x1, y1, &brush->rows);
+    }
+
+    int* candidates = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    float* gathered = (float*)malloc((count > 0 ? count : 1) * 2 * sizeof(float));
+    uint8_t* hits = (uint8_t*)malloc(count > 0 ? count : 1);
+    uint8_t* crosses = (uint8_t*)calloc(count > 0 ? count : 1, 1);
+    if (candidates == NULL || gathered == NULL || hits == NULL || crosses == NULL) {
+        perror("Memory allocation failed for brush candidates");
+        free(touched);
+        free(candidates);
+        free(gathered);
+        free(hits);
+        free(crosses);
+        return false;
+    }
+    count = 0;
+    for (size_t w = 0; w < words; w++) {
+        for (uint64_t word = touched[w]; word; word &= word - 1) candidates[count++] = (int)(w * 64 + __builtin_ctzll(word));
+    }
+
+    // Test the touched rows against every gap the new box reaches
+    int previous = -1;
+    for (int col = 0; col < ds->cols && count > 0; col++) {
+        if (col == ds->class_col_index) continue;
+        int left_col = previous;
+        previous = col;
+        SegmentBoxTest test;
+        float t_lo, t_hi;
+        if (left_col < 0 || !gap_box_test(ds, left_col, col, x0, y0, x1, y1, &test, &t_lo, &t_hi)) continue;
+        for (int k = 0; k < count; k++) {
+            gathered[k] = dataset_value(ds, left_col, candidates[k]);
+            gathered[count + k] = dataset_value(ds, col, candidates[k]);
+        }
+        segment_box_kernel(&test, gathered, gathered + count, count, hits);
+        for (int k = 0; k < count; k++) crosses[k] |= hits[k];
+    }
+    uint64_t* bits = brush->rows.bits;
+    for (int k = 0; k < count; k++) {
+        int row = candidates[k];
+        if (crosses[k]) bits[row >> 6] |= 1ull << (row & 63); else bits[row >> 6] &= ~(1ull << (row & 63));
+    }
+    free(touched);
+    free(candidates);
+    free(gathered);
+    free(hits);
+    free(crosses);
+    return true;
+}
+
+// Folds the brushes into box_selection one 64-row word at a time
+bool combine_brushes(Dataset* ds) {
+    if (!reset_selection(&box_selection, ds->rows, num_classes)) return false;
+    size_t words = ((size_t)ds->rows + 63) / 64;
+    uint64_t* out = box_selection.bits;
+    for (int b = 0; b < num_brushes; b++) {
+        const uint64_t* bits = brushes[b].rows.bits;
+        if (bits == NULL || brushes[b].rows.rows != ds->rows) return false;
+        int op = brushes[b].op;
+        if (b == 0 && op == BRUSH_NOT) {
+            for (size_t w = 0; w < words; w++) out[w] = ~bits[w];
+        } else if (b == 0 || op == BRUSH_OR) {
+            for (size_t w = 0; w < words; w++) out[w] |= bits[w];
+        } else if (op == BRUSH_AND) {
+            for (size_t w = 0; w < words; w++) out[w] &= bits[w];
+        } else {
+            for (size_t w = 0; w < words; w++) out[w] &= ~bits[w];
+        }
+    }
+    if (ds->rows % 64 != 0) out[words - 1] &= (1ull << (ds->rows % 64)) - 1;
+    focus_batch.dirty = true;
+    static_layer.focus_dirty = true;
+    if (ds->tiles != NULL) static_layer.dirty = true; // Brushed rows are colored in the one streamed pass
+    return true;
+}
+
+// Re-evaluates every brush from scratch, after the data or the axes changed
+void refresh_brushes() {
+    if (global_data == NULL) return;
+    for (int b = 0; b < num_brushes; b++) {
+        Brush* brush = &brushes[b];
+        if (!brush_box(global_data, brush->x0, brush->y0, brush->x1, brush->y1, &brush->rows)) {
+            fprintf(stderr, "Failed to evaluate brush %d.\n", b + 1);
+            num_brushes = b;
+            break;
+        }
+    }
+    combine_brushes(global_data);
+}
+
+// Prints the selected rows per class
+void print_selection_counts() {
+    if (global_data == NULL) return;
+    count_selection(&box_selection, global_data);
+    profile_count_rows_picked(box_selection.selected);
+
+    for (int i = 0; i < num_classes; i++) {
+        printf("Class %s: %d\n", class_info[i].class_name, box_selection.class_counts[i]);
+    }
+
+    // The counts above cover every row; a view still accumulating also gets its own
+    if (!aggregate_mode && global_data->tiles == NULL && drawn_rows < global_rows && static_layer.segments_drawn < static_layer.segments_total) {
+        int* drawn = (int*)calloc(num_classes > 0 ? num_classes : 1, sizeof(int));
+        if (drawn != NULL) {
+            for (int i = 0; i < drawn_rows; i++) {
+                int row = i < sample_order_rows ? sample_order[i] : i;
+                if (box_selection.bits[row >> 6] >> (row & 63) & 1) drawn[global_data->class_ids[row]]++;
+            }
+            printf("Of the %d rows drawn so far:\n", drawn_rows);
+            for (int i = 0; i < num_classes; i++) {
+                printf("Class %s: %d\n", class_info[i].class_name, drawn[i]);
+            }
+            free(drawn);
+        }
+    }
+}
+
+// Interns a label through the same hashed dictionary as the class column
+int find_or_add_class_label(ClassDict* labels, const char* label) {
+    return get_class_index(labels, label);
+}
+
+PFNGLGENBUFFERSPROC gl_gen_buffers = NULL;
+PFNGLBINDBUFFERPROC gl_bind_buffer = NULL;
+PFNGLBUFFERDATAPROC gl_buffer_data = NULL;
+PFNGLBUFFERSUBDATAPROC gl_buffer_sub_data = NULL;
+PFNGLDELETEBUFFERSPROC gl_delete_buffers = NULL;
+PFNGLDRAWRANGEELEMENTSPROC gl_draw_range_elements = NULL;
+
+// Looks up a GL entry point through whichever context owner is active
+void* get_gl_proc(const char* name) {
+#ifndef _WIN32
+    if (headless) return (void*)eglGetProcAddress(name);
+#endif
+    return (void*)glutGetProcAddress(name);
+}
+
+// Resolves the buffer object entry points, which need OpenGL 1.5
+void load_buffer_functions() {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 15) return;
+    gl_draw_range_elements = (PFNGLDRAWRANGEELEMENTSPROC)get_gl_proc("glDrawRangeElements");
+
+    gl_gen_buffers = (PFNGLGENBUFFERSPROC)get_gl_proc("glGenBuffers");
+    gl_bind_buffer = (PFNGLBINDBUFFERPROC)get_gl_proc("glBindBuffer");
+    gl_buffer_data = (PFNGLBUFFERDATAPROC)get_gl_proc("glBufferData");
+    gl_buffer_sub_data = (PFNGLBUFFERSUBDATAPROC)get_gl_proc("glBufferSubData");
+    gl_delete_buffers = (PFNGLDELETEBUFFERSPROC)get_gl_proc("glDeleteBuffers");
+    if (!gl_gen_buffers || !gl_bind_buffer || !gl_buffer_data || !gl_buffer_sub_data || !gl_delete_buffers) {
+        gl_gen_buffers = NULL;
+    }
+}
+
+void free_polyline_buffers(PolylineBuffers* buffers) {
+    if (buffers->vertex_vbo) {
+        GLuint vbos[3] = { buffers->vertex_vbo, buffers->color_vbo, buffers->index_vbo };
+        gl_delete_buffers(3, vbos);
+        buffers->vertex_vbo = buffers->color_vbo = buffers->index_vbo = 0;
+    }
+    free(buffers->vertices);
+    free(buffers->colors);
+    free(buffers->indices);
+    free(buffers->density_scale);
+    free(buffers->missing);
+    buffers->vertices = NULL;
+    buffers->colors = NULL;
+    buffers->indices = NULL;
+    buffers->density_scale = NULL;
+    buffers->missing = NULL;
+    buffers->num_indices = 0;
+    buffers->capacity_rows = 0;
+}
+
+// Writes the index pairs of the segments of one polyline, whose vertices start
+// at start. A segment with a missing end collapses onto that vertex, which is
+// placed at 0 with zero alpha, so no NaN reaches GL and the gap stays empty.
+GLuint* add_polyline_segments(GLuint* index, GLuint start, int axes, const uint64_t* missing) {
+    for (int a = 0; a < axes - 1; a++) {
+        GLuint left = start + a, right = left + 1;
+        if (missing[left >> 6] >> (left & 63) & 1) right = left;
+        else if (missing[right >> 6] >> (right & 63) & 1) left = right;
+        *index++ = left;
+        *index++ = right;
+    }
+    return index;
+}
+
+// Fills the vertices, colors and segment indices of the polylines at draw
+// positions [first, last) into arrays starting at position first, with the
+// alpha scales in buffers->density_scale. Positions follow the sample order
+// where there is one, so a slice of the draw order is a contiguous range of
+// vertices, and rows in file order after it.
+void fill_polyline_rows(PolylineBuffers* buffers, Dataset* data, ClassInfo* class_info, float* density, int first, int last,
+                        float* vertices, GLubyte* colors, GLuint* indices) {
+    int rows = data->rows, cols = data->cols, axes = buffers->axes;
+
+    // Fill one axis at a time so every column is read in order, or gathered in sample order
+    for (int col = 0, a = 0; col < cols; col++) {
+        if (col == data->class_col_index) continue;
+        const float* col_density = density ? density + (size_t)col * rows : NULL;
+        const uint8_t* col_levels = density ? NULL : density_levels + (size_t)col * rows;
+        float x = col / (float)(cols - 1);
+        float density_scale = buffers->density_scale[col];
+        bool inverted = axis_inverted[col];
+        float block[COLUMN_BLOCK_ROWS];
+        const float* values = NULL;
+        int block_first = 0;
+        for (int i = first; i < last; i++) {
+            int row = i;
+            float value;
+            if (i < sample_order_rows) {
+                row = sample_order[i];
+                value = dataset_value(data, col, row);
+            } else {
+                if (values == NULL || i - block_first == COLUMN_BLOCK_ROWS) {
+                    block_first = i;
+                    values = column_block(data, col, i, last - i < COLUMN_BLOCK_ROWS ? last - i : COLUMN_BLOCK_ROWS, block);
+                }
+                value = values[i - block_first];
+            }
+            size_t v = (size_t)(i - first) * axes + a;
+            vertices[v * 2] = x;
+            vertices[v * 2 + 1] = inverted ? 1.0f - value : value;
+
+            const ClassInfo* info = &class_info[data->class_ids[row]];
+            GLubyte* color = &colors[v * 4];
+            color[0] = (GLubyte)(info->r * 255.0f + 0.5f);
+            color[1] = (GLubyte)(info->g * 255.0f + 0.5f);
+            color[2] = (GLubyte)(info->b * 255.0f + 0.5f);
+            size_t vertex = (size_t)i * axes + a;
+            if (isnan(value)) {
+                buffers->missing[vertex >> 6] |= 1ull << (vertex & 63);
+                vertices[v * 2 + 1] = 0.0f;
+                color[3] = 0;
+                continue;
+            }
+            buffers->missing[vertex >> 6] &= ~(1ull << (vertex & 63));
+            // Appended rows can be denser than the maximum the scale came from
+            float weight = col_levels ? col_levels[row] * (1.0f / 255.0f) : fminf(col_density[row] * density_scale, 1.0f);
+            color[3] = (GLubyte)((0.35f + 0.65f * weight) * 255.0f + 0.5f);
+        }
+        a++;
+    }
+
+    GLuint* index = indices;
+    for (int i = first; i < last && axes > 1; i++) {
+        index = add_polyline_segments(index, (GLuint)((size_t)i * axes), axes, buffers->missing);
+    }
+}
+
+// Creates a buffer object with room for capacity bytes holding bytes of data
+void upload_buffer(GLenum target, GLuint vbo, size_t capacity, size_t bytes, const void* data) {
+    gl_bind_buffer(target, vbo);
+    if (capacity > bytes) {
+        gl_buffer_data(target, capacity, NULL, GL_DYNAMIC_DRAW);
+        gl_buffer_sub_data(target, 0, bytes, data);
+    } else {
+        gl_buffer_data(target, bytes, data, GL_STATIC_DRAW);
+    }
+    gl_bind_buffer(target, 0);
+}
+
+// Builds one vertex per (row, visible axis) with the class color and a
+// density-weighted alpha, plus the segment indices joining neighboring axes.
+// In follow mode the buffer objects get headroom for appended polylines.
+bool build_polyline_buffers(PolylineBuffers* buffers, Dataset* data, ClassInfo* class_info, float* density) {
+    free_polyline_buffers(buffers);
+
+    int rows = data->rows, cols = data->cols;
+    int axes = 0;
+    buffers->density_scale = (float*)calloc(cols, sizeof(float));
+    if (buffers->density_scale == NULL) return false;
+    for (int col = 0; col < cols; col++) {
+        if (col == data->class_col_index) continue;
+        axes++;
+        if (density == NULL) continue; // Compact levels are already scaled per column
+        const float* col_density = density + (size_t)col * rows;
+        float max_density = 0.0f;
+        for (int row = 0; row < rows; row++) {
+            if (col_density[row] > max_density) max_density = col_density[row];
+        }
+        buffers->density_scale[col] = max_density > 0 ? 1.0f / max_density : 0.0f;
+    }
+
+    size_t num_vertices = (size_t)rows * axes;
+    buffers->rows = rows;
+    buffers->axes = axes;
+    buffers->num_indices = axes > 1 ? (size_t)rows * (axes - 1) * 2 : 0;
+    buffers->vertices = (float*)malloc((num_vertices > 0 ? num_vertices : 1) * 2 * sizeof(float));
+    buffers->colors = (GLubyte*)malloc((num_vertices > 0 ? num_vertices : 1) * 4 * sizeof(GLubyte));
+    buffers->indices = (GLuint*)malloc((buffers->num_indices > 0 ? buffers->num_indices : 1) * sizeof(GLuint));
+    buffers->missing = (uint64_t*)calloc(num_vertices / 64 + 1, sizeof(uint64_t));
+    if (buffers->vertices == NULL || buffers->colors == NULL || buffers->indices == NULL || buffers->missing == NULL) {
+        perror("Memory allocation failed for polyline buffers");
+        free_polyline_buffers(buffers);
+        return false;
+    }
+    fill_polyline_rows(buffers, data, class_info, density, 0, rows, buffers->vertices, buffers->colors, buffers->indices);
+
+    // Move the geometry to the GPU when buffer objects are available
+    if (gl_gen_buffers != NULL) {
+        GLuint vbos[3];
+        gl_gen_buffers(3, vbos);
+        buffers->vertex_vbo = vbos[0];
+        buffers->color_vbo = vbos[1];
+        buffers->index_vbo = vbos[2];
+        buffers->capacity_rows = following ? rows + rows / 2 + FOLLOW_MIN_HEADROOM : rows;
+        size_t capacity = (size_t)buffers->capacity_rows * axes;
+        size_t segments = axes > 1 ? (size_t)buffers->capacity_rows * (axes - 1) * 2 : 0;
+        upload_buffer(GL_ARRAY_BUFFER, buffers->vertex_vbo, capacity * 2 * sizeof(float), num_vertices * 2 * sizeof(float), buffers->vertices);
+        upload_buffer(GL_ARRAY_BUFFER, buffers->color_vbo, capacity * 4 * sizeof(GLubyte), num_vertices * 4 * sizeof(GLubyte), buffers->colors);
+        upload_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index_vbo, segments * sizeof(GLuint), buffers->num_indices * sizeof(GLuint), buffers->indices);
+
+        free(buffers->vertices);
+        free(buffers->colors);
+        free(buffers->indices);
+        buffers->vertices = NULL;
+        buffers->colors = NULL;
+        buffers->indices = NULL;
+    }
+
+    buffers->dirty = false;
+    return true;
+}
+
+// Adds the polylines of rows appended since the last build, keeping that
+// build's alpha scales. Returns false when a full rebuild is needed instead:
+// the buffers are stale or the buffer objects are out of room.
+bool append_polyline_buffers(PolylineBuffers* buffers, Dataset* data, ClassInfo* class_info, float* density) {
+    if (buffers->dirty || buffers->density_scale == NULL || data->rows < buffers->rows) return false;
+    int first = buffers->rows, last = data->rows, axes = buffers->axes;
+    if (first == last) return true;
+    if (buffers->vertex_vbo && last > buffers->capacity_rows) return false;
+    uint64_t* missing = (uint64_t*)realloc(buffers->missing, ((size_t)last * axes / 64 + 1) * sizeof(uint64_t));
+    if (missing == NULL) return false;
+    buffers->missing = missing;
+
+    size_t old_vertices = (size_t)first * axes, new_vertices = (size_t)(last - first) * axes;
+    size_t old_indices = buffers->num_indices, new_indices = axes > 1 ? (size_t)(last - first) * (axes - 1) * 2 : 0;
+    float* vertices;
+    GLubyte* colors;
+    GLuint* indices;
+    if (buffers->vertex_vbo) {
+        vertices = (float*)malloc(new_vertices * 2 * sizeof(float));
+        colors = (GLubyte*)malloc(new_vertices * 4 * sizeof(GLubyte));
+        indices = (GLuint*)malloc((new_indices > 0 ? new_indices : 1) * sizeof(GLuint));
+        if (vertices == NULL || colors == NULL || indices == NULL) {
+            free(vertices);
+            free(colors);
+            free(indices);
+            return false;
+        }
+    } else {
+        float* grown_vertices = (float*)realloc(buffers->vertices, (old_vertices + new_vertices) * 2 * sizeof(float));
+        if (grown_vertices != NULL) buffers->vertices = grown_vertices;
+        GLubyte* grown_colors = (GLubyte*)realloc(buffers->colors, (old_vertices + new_vertices) * 4 * sizeof(GLubyte));
+        if (grown_colors != NULL) buffers->colors = grown_colors;
+        GLuint* grown_indices = (GLuint*)realloc(buffers->indices, (old_indices + new_indices > 0 ? old_indices + new_indices : 1) * sizeof(GLuint));
+        if (grown_indices != NULL) buffers->indices = grown_indices;
+        if (grown_vertices == NULL || grown_colors == NULL || grown_indices == NULL) return false;
+        vertices = buffers->vertices + old_vertices * 2;
+        colors = buffers->colors + old_vertices * 4;
+        indices = buffers->indices + old_indices;
+    }
+    fill_polyline_rows(buffers, data, class_info, density, first, last, vertices, colors, indices);
+
+    if (buffers->vertex_vbo) {
+        gl_bind_buffer(GL_ARRAY_BUFFER, buffers->vertex_vbo);
+        gl_buffer_sub_data(GL_ARRAY_BUFFER, old_vertices * 2 * sizeof(float), new_vertices * 2 * sizeof(float), vertices);
+        gl_bind_buffer(GL_ARRAY_BUFFER, buffers->color_vbo);
+        gl_buffer_sub_data(GL_ARRAY_BUFFER, old_vertices * 4 * sizeof(GLubyte), new_vertices * 4 * sizeof(GLubyte), colors);
+        gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+        gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index_vbo);
+        gl_buffer_sub_data(GL_ELEMENT_ARRAY_BUFFER, old_indices * sizeof(GLuint), new_indices * sizeof(GLuint), indices);
+        gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        free(vertices);
+        free(colors);
+        free(indices);
+    }
+    buffers->rows = last;
+    buffers->num_indices = old_indices + new_indices;
+    return true;
+}
+
+// Points the vertex arrays at the polyline buffers, with per-vertex colors
+// unless colored is false, in which case the current color applies
+void bind_polyline_arrays(PolylineBuffers* buffers, bool colored) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (colored) glEnableClientState(GL_COLOR_ARRAY);
+    if (buffers->vertex_vbo) {
+        gl_bind_buffer(GL_ARRAY_BUFFER, buffers->vertex_vbo);
+        glVertexPointer(2, GL_FLOAT, 0, NULL);
+        gl_bind_buffer(GL_ARRAY_BUFFER, buffers->color_vbo);
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, NULL);
+        gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        glVertexPointer(2, GL_FLOAT, 0, buffers->vertices);
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, buffers->colors);
+    }
+}
+
+void unbind_polyline_arrays() {
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Submits the segment range [first_segment, first_segment + count) in batched
+// draw calls, in a single color while brushes make the polylines context
+void draw_polyline_segments(PolylineBuffers* buffers, size_t first_segment, size_t count, bool context) {
+    bind_polyline_arrays(buffers, !context);
+    if (context) glColor4f(0.45f, 0.45f, 0.45f, 0.08f);
+    const GLuint* indices = buffers->indices;
+    if (buffers->index_vbo) {
+        gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers->index_vbo);
+        indices = NULL; // Offsets into the bound index buffer
+    }
+
+    // Polylines are contiguous, so each batch also names its vertex range,
+    // which spares drivers from processing the vertices before it
+    int segments_per_row = buffers->axes > 1 ? buffers->axes - 1 : 1;
+    for (size_t done = 0; done < count; done += SEGMENTS_PER_DRAW) {
+        size_t batch = count - done < SEGMENTS_PER_DRAW ? count - done : SEGMENTS_PER_DRAW;
+        size_t first = first_segment + done;
+        if (gl_draw_range_elements != NULL) {
+            GLuint start = (GLuint)(first / segments_per_row * buffers->axes);
+            GLuint end = (GLuint)((first + batch - 1) / segments_per_row * buffers->axes + buffers->axes - 1);
+            gl_draw_range_elements(GL_LINES, start, end, (GLsizei)(batch * 2), GL_UNSIGNED_INT, indices + first * 2);
+        } else {
+            glDrawElements(GL_LINES, (GLsizei)(batch * 2), GL_UNSIGNED_INT, indices + first * 2);
+        }
+    }
+    profile_count_vertices((long long)count * 2);
+
+    if (buffers->index_vbo) gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    unbind_polyline_arrays();
+}
+
+// Collects the segments of the selected polylines in draw order, so any
+// prefix of the batch is a sample of the selection
+bool build_focus_batch(FocusBatch* batch, PolylineBuffers* buffers, Selection* selection) {
+    int axes = buffers->axes;
+    size_t selected = 0, words = ((size_t)selection->rows + 63) / 64;
+    for (size_t w = 0; w < words; w++) selected += __builtin_popcountll(selection->bits[w]);
+    free(batch->indices);
+    batch->indices = NULL;
+    batch->num_segments = 0;
+    if (selected == 0 || axes < 2) {
+        batch->dirty = false;
+        return true;
+    }
+    batch->indices = (GLuint*)malloc(selected * (axes - 1) * 2 * sizeof(GLuint));
+    if (batch->indices == NULL) {
+        perror("Memory allocation failed for the brushed polylines");
+        return false;
+    }
+
+    GLuint* index = batch->indices;
+    for (int i = 0; i < buffers->rows; i++) {
+        int row = i < sample_order_rows ? sample_order[i] : i;
+        if (row >= selection->rows || !(selection->bits[row >> 6] >> (row & 63) & 1)) continue;
+        index = add_polyline_segments(index, (GLuint)((size_t)i * axes), axes, buffers->missing);
+    }
+    batch->num_segments = (size_t)(index - batch->indices) / 2;
+    batch->dirty = false;
+    return true;
+}
+
+// Draws the brushed segments [first_segment, first_segment + count) in their class colors
+void draw_focus_segments(size_t first_segment, size_t count) {
+    bind_polyline_arrays(&pc_buffers, true);
+    for (size_t done = 0; done < count; done += SEGMENTS_PER_DRAW) {
+        size_t batch = count - done < SEGMENTS_PER_DRAW ? count - done : SEGMENTS_PER_DRAW;
+        glDrawElements(GL_LINES, (GLsizei)(batch * 2), GL_UNSIGNED_INT, focus_batch.indices + (first_segment + done) * 2);
+    }
+    profile_count_vertices((long long)count * 2);
+    unbind_polyline_arrays();
+}
+
+// Adds rows [first, last) of one column pair to a per-class bins x bins histogram
+void bin_pair_by_class(const float* xs, const float* ys, const int* class_ids, int first, int last, int bins, uint32_t* counts, bool atomic) {
+    for (int row = first; row < last; row++) {
+        float x = xs[row], y = ys[row];
+        if (isnan(x) || isnan(y)) continue;
+        int i = (int)(x * bins), j = (int)(y * bins);
+        i = i < 0 ? 0 : (i >= bins ? bins - 1 : i);
+        j = j < 0 ? 0 : (j >= bins ? bins - 1 : j);
+        uint32_t* count = &counts[((size_t)class_ids[row] * bins + i) * bins + j];
+        if (atomic) __atomic_fetch_add(count, 1, __ATOMIC_RELAXED); else (*count)++;
+    }
+}
+
+void free_aggregate_view(AggregateView* view) {
+    free(view->gap_cols);
+    free(view->counts);
+    free(view->band_vertices);
+    free(view->band_colors);
+    memset(view, 0, sizeof(AggregateView));
+}
+
+typedef struct {
+    AggregateView* view;
+    Dataset* ds;
+    int blocks_per_gap;
+} AggregateJob;
+
+// Bins one row block of one gap; blocks of the same gap share counts atomically
+void aggregate_task(void* ctx, int task) {
+    AggregateJob* job = (AggregateJob*)ctx;
+    AggregateView* view = job->view;
+    int gap = task / job->blocks_per_gap, block = task % job->blocks_per_gap;
+    int new_rows = job->ds->rows - view->binned_rows;
+    int first = view->binned_rows + (int)((long long)new_rows * block / job->blocks_per_gap);
+    int last = view->binned_rows + (int)((long long)new_rows * (block + 1) / job->blocks_per_gap);
+    size_t gap_size = (size_t)view->num_classes * view->bins * view->bins;
+    float xs_block[COLUMN_BLOCK_ROWS], ys_block[COLUMN_BLOCK_ROWS];
+    int class_scratch[COLUMN_BLOCK_ROWS];
+    for (int row = first; row < last; row += COLUMN_BLOCK_ROWS) {
+        int count = last - row < COLUMN_BLOCK_ROWS ? last - row : COLUMN_BLOCK_ROWS;
+        const float* xs = column_block(job->ds, view->gap_cols[gap * 2], row, count, xs_block);
+        const float* ys = column_block(job->ds, view->gap_cols[gap * 2 + 1], row, count, ys_block);
+        const int* class_ids = class_block(job->ds, row, count, class_scratch);
+        bin_pair_by_class(xs, ys, class_ids, 0, count, view->bins, view->counts + gap * gap_size, job->blocks_per_gap > 1);
+    }
+}
+
+// Brings the histograms up to date, binning only rows added since the last call
+bool update_aggregate_view(AggregateView* view, Dataset* ds, int num_classes) {
+    if (view->counts == NULL || view->num_classes != num_classes || ds->rows < view->binned_rows) {
+        free_aggregate_view(view);
+        int axes = 0;
+        view->gap_cols = (int*)malloc(ds->cols * 2 * sizeof(int));
+        if (view->gap_cols == NULL) return false;
+        for (int col = 0, previous = -1; col < ds->cols; col++) {
+            if (col == ds->class_col_index) continue;
+            if (previous >= 0) {
+                view->gap_cols[view->num_gaps * 2] = previous;
+                view->gap_cols[view->num_gaps * 2 + 1] = col;
+                view->num_gaps++;
+            }
+            previous = col;
+            axes++;
+        }
+
+        // Halve the resolution until the histograms fit the memory budget
+        view->num_classes = num_classes;
+        view->bins = AGGREGATE_MAX_BINS;
+        while (view->bins > 8 && (size_t)view->num_gaps * num_classes * view->bins * view->bins * sizeof(uint32_t) > AGGREGATE_BUDGET_BYTES) {
+            view->bins /= 2;
+        }
+        view->counts = (uint32_t*)calloc((size_t)(view->num_gaps > 0 ? view->num_gaps : 1) * (num_classes > 0 ? num_classes : 1) * view->bins * view->bins, sizeof(uint32_t));
+        if (view->counts == NULL) {
+            perror("Memory allocation failed for aggregate histograms");
+            free_aggregate_view(view);
+            return false;
+        }
+    }
+    if (ds->rows == view->binned_rows) return true;
+
+    AggregateJob job = { view, ds, 1 };
+    if (view->num_gaps > 0 && view->num_gaps < num_threads && ds->rows - view->binned_rows > 65536) {
+        job.blocks_per_gap = (num_threads + view->num_gaps - 1) / view->num_gaps;
+    }
+    run_parallel(view->num_gaps * job.blocks_per_gap, aggregate_task, &job);
+    view->binned_rows = ds->rows;
+    view->geometry_dirty = true;
+    return true;
+}
+
+// Turns the non-empty bins into quads joining the left bin interval to the right one.
+// Opacity grows with the log of the count relative to the fullest bin of the gap.
+bool build_aggregate_bands(AggregateView* view, Dataset* ds, ClassInfo* class_info) {
+    size_t gap_size = (size_t)view->num_classes * view->bins * view->bins;
+    size_t num_bands = 0;
+    for (size_t k = 0; k < gap_size * view->num_gaps; k++) {
+        if (view->counts[k]) num_bands++;
+    }
+
+    free(view->band_vertices);
+    free(view->band_colors);
+    view->band_vertices = (float*)malloc((num_bands > 0 ? num_bands : 1) * 8 * sizeof(float));
+    view->band_colors = (GLubyte*)malloc((num_bands > 0 ? num_bands : 1) * 16 * sizeof(GLubyte));
+    view->num_bands = 0;
+    if (view->band_vertices == NULL || view->band_colors == NULL) {
+        perror("Memory allocation failed for aggregate bands");
+        return false;
+    }
+
+    float bin = 1.0f / view->bins;
+    for (int gap = 0; gap < view->num_gaps; gap++) {
+        int left_col = view->gap_cols[gap * 2], right_col = view->gap_cols[gap * 2 + 1];
+        float xa = left_col / (float)(ds->cols - 1), xb = right_col / (float)(ds->cols - 1);
+        const uint32_t* counts = view->counts + gap * gap_size;
+        uint32_t max_count = 0;
+        for (size_t k = 0; k < gap_size; k++) {
+            if (counts[k] > max_count) max_count = counts[k];
+        }
+        float log_max = logf(1.0f + max_count);
+
+        for (int c = 0; c < view->num_classes; c++) {
+            for (int i = 0; i < view->bins; i++) {
+                for (int j = 0; j < view->bins; j++) {
+                    uint32_t count = counts[((size_t)c * view->bins + i) * view->bins + j];
+                    if (count == 0) continue;
+                    float ya = i * bin, yb = j * bin;
+                    if (axis_inverted[left_col]) ya = 1.0f - ya - bin;
+                    if (axis_inverted[right_col]) yb = 1.0f - yb - bin;
+
+                    float* v = &view->band_vertices[view->num_bands * 8];
+                    v[0] = xa; v[1] = ya;
+                    v[2] = xa; v[3] = ya + bin;
+                    v[4] = xb; v[5] = yb + bin;
+                    v[6] = xb; v[7] = yb;
+
+                    GLubyte alpha = (GLubyte)((0.05f + 0.9f * logf(1.0f + count) / log_max) * 255.0f);
+                    GLubyte* color = &view->band_colors[view->num_bands * 16];
+                    for (int corner = 0; corner < 4; corner++) {
+                        color[corner * 4] = (GLubyte)(class_info[c].r * 255.0f + 0.5f);
+                        color[corner * 4 + 1] = (GLubyte)(class_info[c].g * 255.0f + 0.5f);
+                        color[corner * 4 + 2] = (GLubyte)(class_info[c].b * 255.0f + 0.5f);
+                        color[corner * 4 + 3] = alpha;
+                    }
+                    view->num_bands++;
+                }
+            }
+        }
+    }
+    view->geometry_dirty = false;
+    return true;
+}
+
+// Draws the aggregated bands; cost depends on the bins, not the rows
+void draw_aggregate_bands(AggregateView* view, Dataset* ds, ClassInfo* class_info, int num_classes) {
+    if (!update_aggregate_view(view, ds, num_classes)) return;
+    if (view->geometry_dirty && !build_aggregate_bands(view, ds, class_info)) return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, view->band_vertices);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, view->band_colors);
+    glDrawArrays(GL_QUADS, 0, (GLsizei)(view->num_bands * 4));
+    profile_count_vertices((long long)view->num_bands * 4);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Draws the polylines of rows [first, last) of an out-of-core dataset in file
+// order, streaming a row block at a time out of the page cache through client
+// arrays. Alpha comes from the density profiles; with brushes, rows outside the
+// selection are drawn in the same pass as gray context.
+void draw_tiled_polylines(Dataset* data, ClassInfo* class_info, int first, int last) {
+    int cols = data->cols, axes = 0;
+    for (int col = 0; col < cols; col++) axes += col != data->class_col_index;
+    if (axes < 2 || first >= last) return;
+    const TileStore* store = data->tiles;
+    size_t missing_words = (size_t)COLUMN_BLOCK_ROWS * axes / 64 + 1;
+    float* vertices = (float*)malloc((size_t)COLUMN_BLOCK_ROWS * axes * 2 * sizeof(float));
+    GLubyte* colors = (GLubyte*)malloc((size_t)COLUMN_BLOCK_ROWS * axes * 4);
+    GLuint* indices = (GLuint*)malloc((size_t)COLUMN_BLOCK_ROWS * (axes - 1) * 2 * sizeof(GLuint));
+    uint64_t* missing = (uint64_t*)malloc(missing_words * sizeof(uint64_t));
+    if (vertices == NULL || colors == NULL || indices == NULL || missing == NULL) {
+        perror("Memory allocation failed for streamed polylines");
+        free(vertices);
+        free(colors);
+        free(indices);
+        free(missing);
+        return;
+    }
+    bool dim = num_brushes > 0 && box_selection.bits != NULL && box_selection.rows == data->rows;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, vertices);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
+    float block[COLUMN_BLOCK_ROWS];
+    int class_scratch[COLUMN_BLOCK_ROWS];
+    for (int row = first; row < last; row += COLUMN_BLOCK_ROWS) {
+        int count = last - row < COLUMN_BLOCK_ROWS ? last - row : COLUMN_BLOCK_ROWS;
+        const int* class_ids = class_block(data, row, count, class_scratch);
+        memset(missing, 0, missing_words * sizeof(uint64_t));
+        for (int col = 0, a = 0; col < cols; col++) {
+            if (col == data->class_col_index) continue;
+            const float* values = column_block(data, col, row, count, block);
+            float x = col / (float)(cols - 1);
+            float density_scale = store->profile_scale[col];
+            bool inverted = axis_inverted[col];
+            for (int i = 0; i < count; i++) {
+                size_t v = (size_t)i * axes + a;
+                vertices[v * 2] = x;
+                vertices[v * 2 + 1] = inverted ? 1.0f - values[i] : values[i];
+                GLubyte* color = &colors[v * 4];
+                int r = row + i;
+                if (isnan(values[i])) {
+                    missing[v >> 6] |= 1ull << (v & 63);
+                    vertices[v * 2 + 1] = 0.0f;
+                    color[3] = 0;
+                    continue;
+                }
+                if (dim && !(box_selection.bits[r >> 6] >> (r & 63) & 1)) {
+                    color[0] = color[1] = color[2] = 115;
+                    color[3] = 20;
+                    continue;
+                }
+                const ClassInfo* info = &class_info[class_ids[i]];
+                color[0] = (GLubyte)(info->r * 255.0f + 0.5f);
+                color[1] = (GLubyte)(info->g * 255.0f + 0.5f);
+                color[2] = (GLubyte)(info->b * 255.0f + 0.5f);
+                float weight = fminf(profile_density(store, col, values[i]) * density_scale, 1.0f);
+                color[3] = (GLubyte)((0.35f + 0.65f * weight) * 255.0f + 0.5f);
+            }
+            a++;
+        }
+        GLuint* index = indices;
+        for (int i = 0; i < count; i++) index = add_polyline_segments(index, (GLuint)(i * axes), axes, missing);
+        glDrawElements(GL_LINES, count * (axes - 1) * 2, GL_UNSIGNED_INT, indices);
+    }
+    profile_count_vertices((long long)(last - first) * axes);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    free(vertices);
+    free(colors);
+    free(indices);
+    free(missing);
+}
+
+// Adds the next slice of polylines to the static layer, or all that are left
+// with whole set and offscreen. Slices hold whole polylines and take about
+// SLICE_BUDGET_MS at the measured throughput. With brushes, the brushed
+// polylines follow all of them and a slice stops where they start; out of
+// core they are streamed from the tiles and colored in that one pass.
+void draw_parallel_coordinates(Dataset* data, ClassInfo* class_info, int num_classes, float* density, bool whole) {
+    // Both renderers hold unstretched positions, so stretching is only a matrix change
+    double profile_time = profile_start();
+    glPushMatrix();
+    glScalef(stretch_factor_x, stretch_factor_y, 1.0f);
+    if (aggregate_mode) {
+        draw_aggregate_bands(&aggregate_view, data, class_info, num_classes);
+        static_layer.segments_drawn = static_layer.segments_total = 0;
+    } else if (data->tiles != NULL || !pc_buffers.dirty || build_polyline_buffers(&pc_buffers, data, class_info, density)) {
+        glLineWidth(1.0f);
+        StaticLayer* layer = &static_layer;
+        bool tiled = data->tiles != NULL;
+        int axes = tiled ? data->cols - 1 : pc_buffers.axes;
+        int segments_per_row = axes > 1 ? axes - 1 : 0;
+        bool focus = num_brushes > 0 && !tiled;
+        if (focus && focus_batch.dirty) build_focus_batch(&focus_batch, &pc_buffers, &box_selection);
+        size_t context = tiled ? (size_t)data->rows * segments_per_row : pc_buffers.num_indices / 2;
+        layer->context_segments = context;
+        layer->segments_total = context + (focus ? focus_batch.num_segments : 0);
+        if (layer->segments_drawn > layer->segments_total) layer->segments_drawn = layer->segments_total;
+        size_t first = layer->segments_drawn, count = layer->segments_total - first;
+        if (!whole && !headless && segments_per_row > 0) {
+            size_t slice = (size_t)fmax(1.0, segments_per_ms * SLICE_BUDGET_MS / segments_per_row) * segments_per_row;
+            if (slice < count) count = slice;
+            if (focus && first < context && first + count > context) count = context - first;
+        }
+        size_t context_count = first < context ? (count < context - first ? count : context - first) : 0;
+        double draw_time = get_time_seconds();
+        if (context_count > 0 && tiled) {
+            draw_tiled_polylines(data, class_info, (int)(first / segments_per_row), (int)((first + context_count) / segments_per_row));
+        } else if (context_count > 0) {
+            draw_polyline_segments(&pc_buffers, first, context_count, focus);
+        }
+        if (count > context_count) draw_focus_segments(first + context_count - context, count - context_count);
+
+        // Measure the throughput the next slices are sized by
+        if (!headless) {
+            glFinish();
+            double ms = (get_time_seconds() - draw_time) * 1000.0;
+            if (ms >= 1.0) segments_per_ms = 0.5 * segments_per_ms + 0.5 * count / ms;
+        }
+        layer->segments_drawn = first + count;
+        size_t drawn = layer->segments_drawn < context ? layer->segments_drawn : context;
+        drawn_rows = segments_per_row > 0 ? (int)(drawn / segments_per_row) : (tiled ? data->rows : pc_buffers.rows);
+    }
+    glPopMatrix();
+    profile_end(STAGE_PARALLEL_COORDS, profile_time);
+}
+
+// Draws the hovered polyline on top of the view
+void draw_hover_highlight(Dataset* data) {
+    int cols = data->cols;
+    if (hovered_row >= 0 && hovered_row < data->rows) {
+        glColor3f(1.0f, 1.0f, 0.0f); // Highlight color
+        glLineWidth(3.0f); // Increase line width for highlighting
+        glBegin(GL_LINE_STRIP);
+        for (int col = 0; col < cols; col++) {
+            if (col == data->class_col_index) continue;
+            float x = (col / (float)(cols - 1)) * stretch_factor_x;
+            float value = dataset_value(data, col, hovered_row);
+            if (isnan(value)) { // Missing values break the polyline
+                glEnd();
+                glBegin(GL_LINE_STRIP);
+                continue;
+            }
+            float y = axis_inverted[col] ? (1.0f - value) * stretch_factor_y : value * stretch_factor_y;
+            glVertex2f(x, y);
+        }
+        glEnd();
+        profile_count_vertices(cols - 1);
+        glLineWidth(1.0f); // Reset line width back to default
+    }
+}
+
+void renderBitmapString(float x, float y, void *font, char *string) {
+    char *c;
+    if (headless) return; // GLUT fonts need an initialized display
+    glRasterPos2f(x, y);
+    for (c = string; *c != '\0'; c++) {
+        glutBitmapCharacter(font, *c);
+    }
+}
+
+void draw_axis_labels() {
+    if (closest_axis1 != -1 && closest_axis2 != -1) {
+        char axis1_label[50], axis2_label[50];
+        sprintf(axis1_label, "Axis %d", closest_axis1 + 1);
+        sprintf(axis2_label, "Axis %d", closest_axis2 + 1);
+
+        glColor3f(0.0, 0.0, 0.0); // Black color for text
+        renderBitmapString(0.1, 0.95, GLUT_BITMAP_HELVETICA_18, axis1_label); // Render Axis 1 label
+        renderBitmapString(0.1, 0.9, GLUT_BITMAP_HELVETICA_18, axis2_label);  // Render Axis 2 label
+    }
+}
+
+// Size of the surface being drawn, the current window or the offscreen image
+void get_viewport_size(int* width, int* height) {
+    if (headless) {
+        *width = headless_width;
+        *height = headless_height;
+    } else {
+        *width = glutGet(GLUT_WINDOW_WIDTH);
+        *height = glutGet(GLUT_WINDOW_HEIGHT);
+    }
+}
+
+// Shows the finished frame; offscreen frames are read back instead
+void present_frame() {
+    if (headless) glFinish(); else glutSwapBuffers();
+}
+
+// Asks GLUT to redraw the scatter window from any window's callback
+void post_scatter_redisplay() {
+    if (headless) return;
+    int window = glutGetWindow();
+    glutSetWindow(scatter_plot_window);
+    glutPostRedisplay();
+    if (window) glutSetWindow(window);
+}
+
+// Orthographic bounds of the parallel coordinates view, shared by display and picking
+void get_view_bounds(int width, int height, float* left, float* right, float* bottom, float* top) {
+    float margin = 0.05f; // Margin percentage of the screen size
+    float aspect = width > height ? (float)width / height : (float)height / width;
+    // Apply the scale here, making sure it affects both x and y uniformly
+    *left = -margin * aspect * scale;
+    *right = (1.0f + margin) * aspect * scale;
+    *bottom = -margin * scale;
+    *top = (1.0f + margin) * scale;
+}
+
+// Function to convert window coordinates to world coordinates
+void window_to_world(int x, int y, float *world_x, float *world_y) {
+    // Get the size of the window
+    int width = glutGet(GLUT_WINDOW_WIDTH);
+    int height = glutGet(GLUT_WINDOW_HEIGHT);
+
+    // Normalize the mouse coordinates to range [0, 1]
+    float fx = (float)x / (float)width;
+    float fy = 1.0f - (float)y / (float)height; // Invert y since window coordinates origin is top left
+
+    // Apply the inverse of the projection and translation
+    float left, right, bottom, top;
+    get_view_bounds(width, height, &left, &right, &bottom, &top);
+    *world_x = left + fx * (right - left) - translate_x;
+    *world_y = bottom + fy * (top - bottom) - translate_y;
+
+    // Apply the inverse of the stretch transformation if any
+    *world_x /= stretch_factor_x;
+    *world_y /= stretch_factor_y;
+}
+
+void draw_legend() {
+    // Set the starting position for the legend
+    float x_start = 0.01f, y_start = 0.01f;
+    float box_size = 0.02f; // Size of the colored box
+    float vertical_offset = 0.03f; // Vertical space between lines
+
+    // Loop through each class and draw its color and name
+    for (int i = 0; i < num_classes; i++) {
+        // Set the color for the class
+        glColor3f(class_info[i].r, class_info[i].g, class_info[i].b);
+
+        // Draw a small box with the class color
+        glBegin(GL_QUADS);
+            glVertex2f(x_start, y_start - i * vertical_offset);
+            glVertex2f(x_start + box_size, y_start - i * vertical_offset);
+            glVertex2f(x_start + box_size, y_start - box_size - i * vertical_offset);
+            glVertex2f(x_start, y_start - box_size - i * vertical_offset);
+        glEnd();
+
+        // Set the color for the text (black)
+        glColor3f(0.0f, 0.0f, 0.0f);
+
+        // Render the class name next to the box
+        renderBitmapString(x_start + box_size + 0.01f, y_start - box_size/2 - i * vertical_offset, GLUT_BITMAP_HELVETICA_12, class_info[i].class_name);
+    }
+}
+
+// Progress bar with a label along the bottom edge, for loads and samples
+void draw_progress_bar(int width, int height, float fraction, const char* label) {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, width, 0, height);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glColor3f(0.75f, 0.75f, 0.75f);
+    glRecti(10, 10, width - 10, 16);
+    glColor3f(0.2f, 0.4f, 0.8f);
+    glRecti(10, 10, 10 + (int)((width - 20) * fraction), 16);
+    glColor3f(0.0f, 0.0f, 0.0f);
+    renderBitmapString(10.0f, 22.0f, GLUT_BITMAP_HELVETICA_12, (char*)label);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Frame time, stage latencies and counters in the top left corner, in pixels
+void draw_hud(int width, int height) {
+    const int stages[] = { STAGE_DISPLAY, STAGE_PARALLEL_COORDS, STAGE_SCATTER_PLOT, STAGE_MOUSE_MOTION, STAGE_BRUSH };
+    int num_lines = 4 + (int)(sizeof(stages) / sizeof(stages[0]));
+    char line[128];
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, width, 0, height);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glColor4f(1.0f, 1.0f, 1.0f, 0.8f);
+    glRecti(4, height - 8 - num_lines * 16, 384, height - 4);
+    glColor3f(0.0f, 0.0f, 0.0f);
+    float y = height - 20.0f;
+    sprintf(line, "frame %lld  %.2f ms", profiler.frames, profile_last(STAGE_DISPLAY));
+    renderBitmapString(10.0f, y, GLUT_BITMAP_9_BY_15, line);
+    y -= 16.0f;
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++, y -= 16.0f) {
+        double p50, p99;
+        profile_percentiles(stages[i], &p50, &p99);
+        sprintf(line, "%-15s p50 %7.2f  p99 %7.2f ms", stage_names[stages[i]], p50, p99);
+        renderBitmapString(10.0f, y, GLUT_BITMAP_9_BY_15, line);
+    }
+    sprintf(line, "vertices %lld  rows picked %lld", profiler.last_vertices, profiler.last_rows_picked);
+    renderBitmapString(10.0f, y, GLUT_BITMAP_9_BY_15, line);
+    y -= 16.0f;
+    sprintf(line, "load %.1f  normalize %.1f  density %.1f ms", profile_last(STAGE_LOAD), profile_last(STAGE_NORMALIZE), profile_last(STAGE_DENSITY));
+    renderBitmapString(10.0f, y, GLUT_BITMAP_9_BY_15, line);
+    y -= 16.0f;
+    sprintf(line, "rows drawn %d of %d  %.0f segments/ms", drawn_rows, global_rows, segments_per_ms);
+    renderBitmapString(10.0f, y, GLUT_BITMAP_9_BY_15, line);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Whether the static layer draws the brushed polylines over all of them as
+// context; out of core it colors them in one pass and restarts on a new selection
+bool layer_has_context() {
+    return num_brushes > 0 && (global_data == NULL || global_data->tiles == NULL);
+}
+
+// True when the captured layer still shows the current view at this size
+bool static_layer_current(int width, int height) {
+    StaticLayer* layer = &static_layer;
+    return layer->valid && !layer->dirty && layer->width == width && layer->height == height &&
+           layer->translate_x == translate_x && layer->translate_y == translate_y && layer->scale == scale &&
+           layer->stretch_x == stretch_factor_x && layer->stretch_y == stretch_factor_y && layer->aggregate == aggregate_mode &&
+           layer->context == layer_has_context();
+}
+
+// Copies the freshly drawn frame into the layer texture
+void capture_static_layer(int width, int height) {
+    StaticLayer* layer = &static_layer;
+    layer->valid = false;
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    int texture_width = 1, texture_height = 1;
+    while (texture_width < width) texture_width *= 2;
+    while (texture_height < height) texture_height *= 2;
+    if (texture_width > max_size || texture_height > max_size) return;
+
+    while (glGetError() != GL_NO_ERROR) {}
+    if (layer->texture == 0) glGenTextures(1, &layer->texture);
+    glBindTexture(GL_TEXTURE_2D, layer->texture);
+    if (texture_width != layer->texture_width || texture_height != layer->texture_height) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        layer->texture_width = texture_width;
+        layer->texture_height = texture_height;
+    }
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        layer->texture_width = layer->texture_height = 0;
+        return;
+    }
+
+    layer->width = width;
+    layer->height = height;
+    layer->translate_x = translate_x;
+    layer->translate_y = translate_y;
+    layer->scale = scale;
+    layer->stretch_x = stretch_factor_x;
+    layer->stretch_y = stretch_factor_y;
+    layer->aggregate = aggregate_mode;
+    layer->context = layer_has_context();
+    layer->valid = true;
+
+    // Keep the finished context, so a new selection only redraws the brushed polylines
+    if (layer->context && !layer->context_saved && layer->segments_drawn == layer->context_segments) {
+        if (layer->context_texture == 0) glGenTextures(1, &layer->context_texture);
+        glBindTexture(GL_TEXTURE_2D, layer->context_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        layer->context_saved = glGetError() == GL_NO_ERROR;
+    }
+    layer->dirty = false;
+}
+
+// Fills the viewport with a captured layer texture, pixel for pixel
+void composite_static_layer(GLuint texture) {
+    StaticLayer* layer = &static_layer;
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 1.0, 0.0, 1.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    float s = layer->width / (float)layer->texture_width;
+    float t = layer->height / (float)layer->texture_height;
+    glDisable(GL_BLEND);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
+        glTexCoord2f(s, 0.0f); glVertex2f(1.0f, 0.0f);
+        glTexCoord2f(s, t); glVertex2f(1.0f, 1.0f);
+        glTexCoord2f(0.0f, t); glVertex2f(0.0f, 1.0f);
+    glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+}
+
+// Orthographic projection with a small margin, then the pan
+void set_view_transform(int width, int height) {
+    float left, right, bottom, top;
+    get_view_bounds(width, height, &left, &right, &bottom, &top);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(left, right, bottom, top, -1.0, 1.0);
+
+    // Switch back to the modelview matrix
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(translate_x, translate_y, 0.0f);
+}
+
+// The polylines or density bands, the part of the view worth caching
+void draw_static_layer(bool whole) {
+    if (global_data != NULL && class_info != NULL && (density != NULL || density_levels != NULL || global_data->tiles != NULL)) {
+        draw_parallel_coordinates(global_data, class_info, num_classes, density, whole);
+    }
+}
+
+// Idle callback: keeps frames coming while the static layer has slices left.
+// GLUT handles input between them, and a view change restarts the layer.
+void accumulate_idle() {
+    StaticLayer* layer = &static_layer;
+    if (!layer->valid || layer->segments_drawn >= layer->segments_total) {
+        glutIdleFunc(NULL);
+        return;
+    }
+    glutSetWindow(parallel_coords_window);
+    glutPostRedisplay();
+}
+
+// Ticks and labels at the positions of the categorical columns' codes, at
+// most MAX_CATEGORY_LABELS per axis
+void draw_category_labels() {
+    if (global_data == NULL || global_data->categories == NULL) return;
+    glColor3f(0.0f, 0.0f, 0.0f);
+    for (int col = 0; col < global_cols; col++) {
+        if (!global_data->categorical[col]) continue;
+        ClassDict* categories = &global_data->categories[col];
+        int count = categories->num_classes;
+        int step = (count + MAX_CATEGORY_LABELS - 1) / MAX_CATEGORY_LABELS;
+        float x = (col / (float)(global_cols - 1)) * stretch_factor_x;
+        for (int k = 0; k < count; k += step) {
+            float value = count > 1 ? k / (float)(count - 1) : 0.5f;
+            float y = axis_inverted[col] ? (1.0f - value) * stretch_factor_y : value * stretch_factor_y;
+            glBegin(GL_LINES);
+            glVertex2f(x - 0.005f, y);
+            glVertex2f(x + 0.005f, y);
+            glEnd();
+            renderBitmapString(x + 0.008f, y, GLUT_BITMAP_HELVETICA_10, categories->class_info[k].class_name);
+        }
+    }
+}
+
+// Axes, inversion stars and legend, drawn over the static layer every frame
+void draw_decorations() {
+    // Draw axis for each attribute
+    draw_axes(global_cols);
+    draw_category_labels();
+
+    // Draw stars for inverted axes
+    for (int col = 0; col < global_cols; col++) {
+        if (col == global_class_col_index) continue; // Skip the 'class' column
+
+        if (axis_inverted[col]) {
+            float x = (col / (float)(global_cols - 1)) * stretch_factor_x;
+            float y = -0.05f; // Position below the axis line
+            draw_star(x, y, 0.01f); // Adjust the size as needed
+        }
+    }
+
+    // Reset the line width back to default if you changed it
+    glLineWidth(1.0f);
+
+    draw_legend();
+}
+
+void display() {
+    double profile_time = profile_start();
+
+    // Set up the viewport
+    int width, height;
+    get_viewport_size(&width, &height);
+    glViewport(0, 0, width, height);
+
+    // Restart the static layer when the view changed, otherwise reuse it and
+    // add the next slice while it is incomplete. A new selection goes back
+    // to the saved context when brushed polylines were drawn already.
+    StaticLayer* layer = &static_layer;
+    bool current = static_layer_current(width, height);
+    bool rewind = current && layer->focus_dirty && layer->segments_drawn > layer->context_segments;
+    if (rewind && !layer->context_saved) current = false;
+    if (current) {
+        composite_static_layer(rewind ? layer->context_texture : layer->texture);
+        if (rewind) layer->segments_drawn = layer->context_segments;
+    } else {
+        glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        layer->segments_drawn = layer->segments_total = 0;
+        layer->context_saved = false;
+    }
+    bool refocus = layer->focus_dirty;
+    layer->focus_dirty = false;
+    if (!current || refocus || layer->segments_drawn < layer->segments_total) {
+        set_view_transform(width, height);
+        draw_static_layer(false);
+        capture_static_layer(width, height);
+        if (!static_layer.valid) {
+            draw_static_layer(true); // Nothing to accumulate into, finish in this frame
+        } else if (!headless && static_layer.segments_drawn < static_layer.segments_total) {
+            glutIdleFunc(accumulate_idle);
+        }
+    }
+
+    // Overlay: axes and legend, the hovered polyline and the brushes
+    set_view_transform(width, height);
+    draw_decorations();
+    if (global_data != NULL) draw_hover_highlight(global_data);
+    draw_brushes();
+    char label[96];
+    if (loading) {
+        sprintf(label, "Loading %.0f%%, %d rows", load_fraction * 100.0f, load_rows);
+        draw_progress_bar(width, height, load_fraction, label);
+    } else if (!aggregate_mode && drawn_rows < global_rows && static_layer.segments_drawn < static_layer.segments_total) {
+        sprintf(label, "Drawing %d of %d rows", drawn_rows, global_rows);
+        draw_progress_bar(width, height, drawn_rows / (float)global_rows, label);
+    } else if (!aggregate_mode && layer->segments_drawn < layer->segments_total) {
+        float fraction = (layer->segments_drawn - layer->context_segments) / (float)(layer->segments_total - layer->context_segments);
+        int brushed = pc_buffers.axes > 1 ? (int)(focus_batch.num_segments / (pc_buffers.axes - 1)) : 0;
+        sprintf(label, "Drawing %d brushed rows", brushed);
+        draw_progress_bar(width, height, fraction, label);
+    }
+    if (hud_visible) draw_hud(width, height);
+
+    present_frame();
+    profile_end(STAGE_DISPLAY, profile_time);
+    profile_frame_end();
+}
+
+void init() {
+    // Enable line smoothing
+    glEnable(GL_LINE_SMOOTH);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+
+    load_buffer_functions();
+}
+
+void keyboard(unsigned char key, int x, int y) {
+    const float translate_increment = 0.01f;
+    const float scale_increment = 0.01f;
+    const float stretch_increment = 0.01f;
+
+    switch (key) {
+        case 27: // exit
+            exit(0);
+            break;
+        case 'r': // increase y stretch
+            stretch_factor_y += stretch_increment;
+            break;
+        case 'f': // decrease y stretch
+            stretch_factor_y = (stretch_factor_y > stretch_increment) ? stretch_factor_y - stretch_increment : 0.1f;
+            break;
+        case 's': // pan down
+            translate_y += translate_increment;
+            break;
+        case 'w': // pan up
+            translate_y -= translate_increment;
+            break;
+        case 'd': // pan right
+            translate_x -= translate_increment;
+            break;
+        case 'a': // pan left
+            translate_x += translate_increment;
+            break;
+        case 'q': // shrink
+            stretch_factor_x = (stretch_factor_x > stretch_increment) ? stretch_factor_x - stretch_increment : 0.1f;
+            break;
+        case 'e': // stretch
+            stretch_factor_x += stretch_increment;
+            break;
+        case '-': // zoom in
+            scale += scale_increment;
+            break;
+        case '+': // zoom out
+            scale = (scale > scale_increment) ? scale - scale_increment : scale_increment;
+            break;
+        case ']': // widen density brush
+        case '[': // narrow density brush
+            brush_size = key == ']' ? brush_size * 1.25f : fmaxf(brush_size / 1.25f, 0.0005f);
+            if (global_data != NULL && global_data->tiles != NULL && global_data->tiles->profile != NULL) {
+                // The profiles answer any brush size, only the alpha scales change
+                update_profile_scales(global_data->tiles);
+                static_layer.dirty = true;
+            } else if (global_data != NULL && (density != NULL || density_levels != NULL)) {
+                double start_time = get_time_seconds();
+                if (density) calculate_density(global_data, density); else calculate_density_levels(global_data, density_levels);
+                profile_record(STAGE_DENSITY, get_time_seconds() - start_time);
+                pc_buffers.dirty = true;
+                static_layer.dirty = true;
+                printf("Density brush size %g recomputed in %.3f s\n", brush_size, get_time_seconds() - start_time);
+            }
+            break;
+        case 'm': // toggle aggregated density bands
+            aggregate_mode = !aggregate_mode;
+            break;
+        case 'h': // toggle the performance HUD
+            hud_visible = !hud_visible;
+            profiling = hud_visible || profiler.trace != NULL;
+            break;
+        case 'x': // toggle the scatter plot matrix
+            splom_mode = !splom_mode;
+            post_scatter_redisplay();
+            break;
+        default:
+            if (DEBUG) {
+                printf("%d\n", key);
+            }
+    }
+    if (DEBUG) {
+        printf("Transforms %lf, %lf, %lf, %lf, %lf\n", stretch_factor_x, stretch_factor_y, scale, translate_x, translate_y);
+    }
+    glutPostRedisplay();
+}
+
+void mouse(int button, int state, int x, int y) {
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+        float normalized_x, normalized_y;
+        window_to_world(x, y, &normalized_x, &normalized_y);
+        float axis_space = 1.0f / (global_cols - 1);
+
+        // Determine which axis was clicked
+        for (int i = 0; i < global_cols; ++i) {
+            if (i == global_class_col_index) continue; // Skip class column
+            float axis_x = i * axis_space;
+            if (normalized_x >= axis_x - axis_space / 2 && normalized_x < axis_x + axis_space / 2) {
+                // Invert the axis
+                axis_inverted[i] = !axis_inverted[i];
+                pc_buffers.dirty = true;
+                static_layer.dirty = true;
+                aggregate_view.geometry_dirty = true;
+                pick_index.dirty = true;
+                refresh_brushes();
+                if (splom_mode) post_scatter_redisplay();
+                glutPostRedisplay(); // Request to redraw the graph
+                break;
+            }
+        }
+    }
+    
+    // Right drag brushes: alone it replaces the brushes, with shift it adds
+    // rows, with ctrl it intersects and with alt it removes rows. Out of core
+    // a brush is evaluated once, when the drag ends, as every test streams the tiles.
+    if (button == GLUT_RIGHT_BUTTON && global_data != NULL) {
+        bool live = global_data->tiles == NULL;
+        if (state == GLUT_DOWN && !dragging_brush) {
+            int modifiers = glutGetModifiers();
+            int op = BRUSH_OR;
+            if (modifiers & GLUT_ACTIVE_CTRL) op = BRUSH_AND;
+            else if (modifiers & GLUT_ACTIVE_ALT) op = BRUSH_NOT;
+            else if (!(modifiers & GLUT_ACTIVE_SHIFT)) num_brushes = 0;
+            if (num_brushes == MAX_BRUSHES) {
+                printf("At most %d brushes, a right click without modifiers clears them.\n", MAX_BRUSHES);
+                return;
+            }
+            window_to_world(x, y, &drag_start_x, &drag_start_y);
+            Brush* brush = &brushes[num_brushes++];
+            brush->op = op;
+            brush->x0 = brush->x1 = drag_start_x;
+            brush->y0 = brush->y1 = drag_start_y;
+            bool ok = live ? brush_box(global_data, brush->x0, brush->y0, brush->x1, brush->y1, &brush->rows)
+                           : reset_selection(&brush->rows, global_data->rows, num_classes);
+            if (!ok) {
+                fprintf(stderr, "Failed to evaluate the brush.\n");
+                num_brushes--;
+                return;
+            }
+            if (live) combine_brushes(global_data);
+            dragging_brush = true;
+        } else if (state == GLUT_UP && dragging_brush) {
+            // A click without a drag leaves no brush behind
+            dragging_brush = false;
+            Brush* brush = &brushes[num_brushes - 1];
+            if (brush->x0 == brush->x1 || brush->y0 == brush->y1) {
+                num_brushes--;
+                combine_brushes(global_data);
+            } else if (!live && (!brush_box(global_data, brush->x0, brush->y0, brush->x1, brush->y1, &brush->rows) ||
+                                 !combine_brushes(global_data))) {
+                fprintf(stderr, "Failed to evaluate the brush.\n");
+                num_brushes--;
+                combine_brushes(global_data);
+            }
+            if (num_brushes > 0) print_selection_counts();
+        }
+        glutPostRedisplay();
+    }
+}
 
-    // Apply the inverse of the stretch transformation if any
-    *world_x /= stretch_factor_x;
-    *world_y /= stretch_factor_y;
+// Drag callback: moves the brush being dragged and updates the selection live,
+// or out of core only the box
+void brush_motion(int x, int y) {
+    if (!dragging_brush || global_data == NULL) return;
+    double start_time = get_time_seconds();
+    float world_x, world_y;
+    window_to_world(x, y, &world_x, &world_y);
+    if (global_data->tiles != NULL) {
+        Brush* brush = &brushes[num_brushes - 1];
+        brush->x0 = fminf(drag_start_x, world_x);
+        brush->x1 = fmaxf(drag_start_x, world_x);
+        brush->y0 = fminf(drag_start_y, world_y);
+        brush->y1 = fmaxf(drag_start_y, world_y);
+        glutPostRedisplay();
+        return;
+    }
+    if (!move_brush(global_data, &brushes[num_brushes - 1], drag_start_x, drag_start_y, world_x, world_y) ||
+        !combine_brushes(global_data)) {
+        fprintf(stderr, "Failed to evaluate the brush.\n");
+        dragging_brush = false;
+        num_brushes--;
+        combine_brushes(global_data);
+    }
+    if (profiling) profile_record(STAGE_BRUSH, get_time_seconds() - start_time);
+    glutPostRedisplay();
 }
 
-void draw_legend() {
-    // Set the starting position for the legend
-    float x_start = 0.01f, y_start = 0.01f;
-    float box_size = 0.02f; // Size of the colored box
-    float vertical_offset = 0.03f; // Vertical space between lines
+void free_pick_index(PickIndex* index) {
+    for (int g = 0; g < index->num_gaps; g++) {
+        free(index->gaps[g].cell_start);
+        free(index->gaps[g].cell_rows);
+        free(index->gaps[g].cell_values);
+        free(index->gaps[g].cell_levels);
+    }
+    free(index->gaps);
+    index->gaps = NULL;
+    index->num_gaps = 0;
+}
 
-    // Loop through each class and draw its color and name
-    for (int i = 0; i < num_classes; i++) {
-        // Set the color for the class
-        glColor3f(class_info[i].r, class_info[i].g, class_info[i].b);
+// Grid cell of a displayed value in [0, 1]
+int pick_cell(float value, int grid) {
+    int cell = (int)(value * grid);
+    return cell < 0 ? 0 : (cell >= grid ? grid - 1 : cell);
+}
 
-        // Draw a small box with the class color
+// Buckets the segments of one gap with a counting sort over the grid cells
+void build_gap_index_task(void* ctx, int task) {
+    PickIndex* index = (PickIndex*)ctx;
+    GapIndex* gap = &index->gaps[task];
+    int grid = index->grid;
+    int rows = global_data->rows;
+    bool compact = global_data->quantized != NULL;
+    bool left_inverted = axis_inverted[gap->left_col];
+    bool right_inverted = axis_inverted[gap->right_col];
+
+    gap->cell_start = (int*)calloc(grid * grid + 1, sizeof(int));
+    gap->cell_rows = (int*)malloc((rows > 0 ? rows : 1) * sizeof(int));
+    if (compact) {
+        gap->cell_levels = (uint16_t*)malloc((rows > 0 ? rows : 1) * 2 * sizeof(uint16_t));
+    } else {
+        gap->cell_values = (float*)malloc((rows > 0 ? rows : 1) * 2 * sizeof(float));
+    }
+    int* cells = (int*)malloc((rows > 0 ? rows : 1) * sizeof(int));
+    if (gap->cell_start == NULL || gap->cell_rows == NULL || (gap->cell_values == NULL && gap->cell_levels == NULL) || cells == NULL) {
+        perror("Memory allocation failed for pick index");
+        free(cells);
+        return;
+    }
+
+    for (int row = 0; row < rows; row++) {
+        float left = dataset_value(global_data, gap->left_col, row);
+        float right = dataset_value(global_data, gap->right_col, row);
+        float y1 = left_inverted ? 1.0f - left : left;
+        float y2 = right_inverted ? 1.0f - right : right;
+        cells[row] = (isnan(y1) || isnan(y2)) ? -1 : pick_cell(y1, grid) * grid + pick_cell(y2, grid);
+        if (cells[row] >= 0) gap->cell_start[cells[row] + 1]++;
+    }
+    for (int c = 0; c < grid * grid; c++) {
+        gap->cell_start[c + 1] += gap->cell_start[c];
+    }
+    int* fill = (int*)malloc(grid * grid * sizeof(int));
+    if (fill == NULL) {
+        perror("Memory allocation failed for pick index");
+        free(cells);
+        return;
+    }
+    memcpy(fill, gap->cell_start, grid * grid * sizeof(int));
+    for (int row = 0; row < rows; row++) {
+        if (cells[row] < 0) continue;
+        int k = fill[cells[row]]++;
+        gap->cell_rows[k] = row;
+        if (compact) {
+            uint16_t left = global_data->quantized[gap->left_col][row];
+            uint16_t right = global_data->quantized[gap->right_col][row];
+            gap->cell_levels[k * 2] = left_inverted ? QUANT_MAX - left : left;
+            gap->cell_levels[k * 2 + 1] = right_inverted ? QUANT_MAX - right : right;
+        } else {
+            float left = global_data->columns[gap->left_col][row];
+            float right = global_data->columns[gap->right_col][row];
+            gap->cell_values[k * 2] = left_inverted ? 1.0f - left : left;
+            gap->cell_values[k * 2 + 1] = right_inverted ? 1.0f - right : right;
+        }
+    }
+    free(fill);
+    free(cells);
+}
+
+bool build_pick_index(PickIndex* index) {
+    free_pick_index(index);
+    int axes = 0;
+    for (int col = 0; col < global_cols; col++) {
+        if (col != global_class_col_index) axes++;
+    }
+    index->num_gaps = axes > 1 ? axes - 1 : 0;
+    index->gaps = (GapIndex*)calloc(index->num_gaps > 0 ? index->num_gaps : 1, sizeof(GapIndex));
+    if (index->gaps == NULL) return false;
+
+    // Aim for about eight segments per cell
+    index->grid = PICK_GRID_MIN;
+    while (index->grid < PICK_GRID_MAX && (double)index->grid * index->grid * 8 < global_rows) index->grid *= 2;
+
+    int g = 0, previous = -1;
+    for (int col = 0; col < global_cols; col++) {
+        if (col == global_class_col_index) continue;
+        if (previous >= 0) {
+            index->gaps[g].left_col = previous;
+            index->gaps[g].right_col = col;
+            g++;
+        }
+        previous = col;
+    }
+
+    run_parallel(index->num_gaps, build_gap_index_task, index);
+    for (g = 0; g < index->num_gaps; g++) {
+        GapIndex* gap = &index->gaps[g];
+        if (gap->cell_start == NULL || gap->cell_rows == NULL || (gap->cell_values == NULL && gap->cell_levels == NULL)) return false;
+    }
+    index->dirty = false;
+    return true;
+}
+
+// Finds the row whose segment in the gap is nearest to the unstretched world
+// point (wx, wy), measuring distances on screen, i.e. after stretching.
+// The search walks the grid cells whose segments pass within the current
+// best distance, using a per-cell lower bound so steep cells are skipped.
+int pick_nearest_in_gap(GapIndex* gap, int grid, float wx, float wy, float* best_distance) {
+    float xa = gap->left_col / (float)(global_cols - 1);
+    float xb = gap->right_col / (float)(global_cols - 1);
+    float t = (wx - xa) / (xb - xa);
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+    float sx = stretch_factor_x, sy = stretch_factor_y;
+    float level_sy = sy / QUANT_MAX; // Dequantizes and stretches compact heights at once
+    float width = (xb - xa) * sx;
+    float cell = 1.0f / grid;
+
+    int best_row = -1;
+    float best = FLT_MAX, best_sq = FLT_MAX;
+    float px = (wx - xa) * sx, py = wy * sy; // Cursor relative to the left axis
+
+    // Grow the vertical search band until something is found, then widen it
+    // once more to the largest band that can still hold a closer segment
+    float scanned = -1.0f; // Cells with a nearer vertical distance were already searched
+    for (float band = cell; ; band *= 2.0f) {
+        float limit = best < FLT_MAX ? best * sqrtf(width * width + sy * sy) / width / sy : band;
+        if (limit > 1.0f + cell) limit = 1.0f + cell;
+
+        // Walk only the cells that can reach the band, solving for the range
+        // of the axis with the larger weight at this cursor position
+        bool by_left = t >= 0.5f;
+        float weight_outer = by_left ? 1.0f - t : t;
+        float weight_inner = by_left ? t : 1.0f - t;
+        for (int outer = 0; outer < grid; outer++) {
+            float outer_lo = outer * cell, outer_hi = outer_lo + cell;
+            int inner_first = (int)floorf((wy - limit - weight_outer * outer_hi) / weight_inner * grid);
+            int inner_last = (int)floorf((wy + limit - weight_outer * outer_lo) / weight_inner * grid);
+            if (inner_first < 0) inner_first = 0;
+            if (inner_last > grid - 1) inner_last = grid - 1;
+
+            for (int inner = inner_first; inner <= inner_last; inner++) {
+                int i = by_left ? outer : inner;
+                int j = by_left ? inner : outer;
+                float ya_lo = i * cell, ya_hi = ya_lo + cell;
+                float yb_lo = j * cell, yb_hi = yb_lo + cell;
+
+                // Range of the segment heights under the cursor for this cell
+                float y_lo = (1.0f - t) * ya_lo + t * yb_lo;
+                float y_hi = (1.0f - t) * ya_hi + t * yb_hi;
+                float vertical = wy < y_lo ? y_lo - wy : (wy > y_hi ? wy - y_hi : 0.0f);
+                if (vertical > limit || vertical <= scanned) continue;
+
+                // Steepest possible segment in the cell bounds how much the
+                // perpendicular distance can undercut the vertical one
+                float rise = fmaxf(fabsf(yb_hi - ya_lo), fabsf(ya_hi - yb_lo)) * sy;
+                float lower_bound = vertical * sy * width / sqrtf(width * width + rise * rise);
+                if (lower_bound >= best) continue;
+
+                for (int k = gap->cell_start[i * grid + j]; k < gap->cell_start[i * grid + j + 1]; k++) {
+                    // Squared distance to the segment, clamped to its end points
+                    float y1, y2;
+                    if (gap->cell_levels) {
+                        y1 = gap->cell_levels[k * 2] * level_sy;
+                        y2 = gap->cell_levels[k * 2 + 1] * level_sy;
+                    } else {
+                        y1 = gap->cell_values[k * 2] * sy;
+                        y2 = gap->cell_values[k * 2 + 1] * sy;
+                    }
+                    float dy = y2 - y1;
+                    float lambda = (px * width + (py - y1) * dy) / (width * width + dy * dy);
+                    lambda = lambda < 0.0f ? 0.0f : (lambda > 1.0f ? 1.0f : lambda);
+                    float ex = px - lambda * width, ey = py - y1 - lambda * dy;
+                    float distance_sq = ex * ex + ey * ey;
+                    if (distance_sq < best_sq) {
+                        best_sq = distance_sq;
+                        best = sqrtf(distance_sq);
+                        best_row = gap->cell_rows[k];
+                    }
+                }
+            }
+        }
+
+        scanned = limit;
+        if (best_row >= 0) {
+            float needed = best * sqrtf(width * width + sy * sy) / width / sy;
+            if (needed <= limit || limit >= 1.0f + cell) break;
+        } else if (band >= 1.0f + cell) {
+            break;
+        }
+    }
+
+    *best_distance = best;
+    return best_row;
+}
+
+// Returns the row whose polyline passes nearest to the unstretched world point
+int pick_row(float wx, float wy) {
+    if (global_data == NULL || global_rows == 0 || global_data->tiles != NULL) return -1; // No pick index out of core
+    if (pick_index.dirty && !build_pick_index(&pick_index)) return -1;
+    if (pick_index.num_gaps == 0) return -1;
+
+    // Gap under the cursor, clamped to the outermost gaps
+    int g = 0;
+    while (g < pick_index.num_gaps - 1 && wx > pick_index.gaps[g].right_col / (float)(global_cols - 1)) g++;
+
+    float distance;
+    return pick_nearest_in_gap(&pick_index.gaps[g], pick_index.grid, wx, wy, &distance);
+}
+
+// Finds the two axes and the polyline nearest to a world point, returning
+// whether any of them changed
+bool update_hover(float world_x, float world_y) {
+    // Find the two closest axes
+    int previous_axis1 = closest_axis1, previous_axis2 = closest_axis2;
+    closest_axis1 = -1;
+    closest_axis2 = -1;
+    float min_distance1 = FLT_MAX;
+    float min_distance2 = FLT_MAX;
+
+    for (int col = 0; col < global_cols; col++) {
+        if (col == global_class_col_index) continue;
+
+        float axis_x = (float)col / (global_cols - 1);
+        float distance = fabs(world_x - axis_x);
+
+        if (distance < min_distance1) {
+            min_distance2 = min_distance1;
+            closest_axis2 = closest_axis1;
+            min_distance1 = distance;
+            closest_axis1 = col;
+        } else if (distance < min_distance2) {
+            min_distance2 = distance;
+            closest_axis2 = col;
+        }
+    }
+
+    // Find the polyline closest to the mouse position
+    int previous_row = hovered_row;
+    hovered_row = pick_row(world_x, world_y);
+    return hovered_row != previous_row || closest_axis1 != previous_axis1 || closest_axis2 != previous_axis2;
+}
+
+void mouse_motion(int x, int y) {
+    double profile_time = profile_start();
+
+    // Convert window coordinates to world coordinates
+    float world_x, world_y;
+    window_to_world(x, y, &world_x, &world_y);
+
+    // Only the overlay changes with the hovered row, and the scatter plot
+    // only depends on the two nearest axes
+    int previous_axis1 = closest_axis1, previous_axis2 = closest_axis2;
+    bool changed = update_hover(world_x, world_y);
+    profile_count_rows_picked(hovered_row >= 0);
+    if (!changed) {
+        profile_end(STAGE_MOUSE_MOTION, profile_time);
+        return;
+    }
+
+    if (closest_axis1 != previous_axis1 || closest_axis2 != previous_axis2) {
+        glutSetWindow(scatter_plot_window);
+        glutPostRedisplay();
+    }
+
+    glutSetWindow(parallel_coords_window);
+    glutPostRedisplay();
+    profile_end(STAGE_MOUSE_MOTION, profile_time);
+}
+
+// Scatter plots are cached per unordered axis pair. Up to SCATTER_POINT_ROWS
+// rows a pair keeps point arrays, above that (and out of core) a background
+// thread bins it into a density image so the view shows density instead of
+// overdrawn points.
+#define SCATTER_CACHE_SLOTS 64
+#define SCATTER_CACHE_BUDGET ((size_t)256 << 20)
+#define SCATTER_POINT_ROWS 200000
+#define SCATTER_MAX_BINS 256
+#define SCATTER_HISTOGRAM_BUDGET ((size_t)64 << 20)
+
+enum { SCATTER_EMPTY, SCATTER_QUEUED, SCATTER_BUILDING, SCATTER_READY };
+
+typedef struct {
+    int axis_x, axis_y;    // axis_x < axis_y, drawn transposed for the other order
+    int state;
+    int num_points;        // Point arrays for small datasets
+    float* vertices;
+    GLubyte* colors;
+    int bins;              // Density image for large ones, bins x bins RGBA
+    GLubyte* image;        // Freed once uploaded into texture
+    GLuint texture;
+    size_t bytes;
+    unsigned long long last_used;
+} ScatterEntry;
+
+typedef struct {
+    ScatterEntry entries[SCATTER_CACHE_SLOTS];
+    size_t used;               // Bytes held by ready entries
+    unsigned long long clock;  // Lookup counter for the LRU order
+    int generation;            // Bumped on clear so in-flight builds are dropped
+    bool flush;                // Clear requested, GL objects released at the next draw
+    bool worker_started;
+    bool polling;              // A GLUT timer is waiting for queued builds
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_mutex_t build_lock; // Held while the worker reads the dataset, so it can grow meanwhile
+    pthread_cond_t wake;
+} ScatterCache;
+
+ScatterCache scatter_cache = { .lock = PTHREAD_MUTEX_INITIALIZER, .build_lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+// Bins a pair into per-class counts and flattens them to an RGBA image: each bin
+// gets the count-weighted mean class color and an opacity growing with log count
+GLubyte* build_scatter_image(Dataset* ds, int axis_x, int axis_y, int max_bins, int* bins_out) {
+    int classes = num_classes > 0 ? num_classes : 1;
+    int bins = max_bins;
+    while (bins > 16 && (size_t)classes * bins * bins * sizeof(uint32_t) > SCATTER_HISTOGRAM_BUDGET) bins /= 2;
+
+    uint32_t* counts = (uint32_t*)calloc((size_t)classes * bins * bins, sizeof(uint32_t));
+    GLubyte* image = (GLubyte*)calloc((size_t)bins * bins * 4, 1);
+    if (counts == NULL || image == NULL) {
+        perror("Memory allocation failed for scatter histogram");
+        free(counts);
+        free(image);
+        return NULL;
+    }
+    float xs_block[COLUMN_BLOCK_ROWS], ys_block[COLUMN_BLOCK_ROWS];
+    int class_scratch[COLUMN_BLOCK_ROWS];
+    for (int row = 0; row < ds->rows; row += COLUMN_BLOCK_ROWS) {
+        int count = ds->rows - row < COLUMN_BLOCK_ROWS ? ds->rows - row : COLUMN_BLOCK_ROWS;
+        const float* xs = column_block(ds, axis_x, row, count, xs_block);
+        const float* ys = column_block(ds, axis_y, row, count, ys_block);
+        const int* class_ids = class_block(ds, row, count, class_scratch);
+        bin_pair_by_class(xs, ys, class_ids, 0, count, bins, counts, false);
+    }
+
+    // Histogram is [class][x bin][y bin], the image is row-major with y up
+    size_t plane = (size_t)bins * bins;
+    uint32_t max_total = 0;
+    for (size_t cell = 0; cell < plane; cell++) {
+        uint32_t total = 0;
+        for (int c = 0; c < classes; c++) total += counts[c * plane + cell];
+        if (total > max_total) max_total = total;
+    }
+    float log_max = logf(1.0f + max_total);
+    for (int i = 0; i < bins; i++) {
+        for (int j = 0; j < bins; j++) {
+            size_t cell = (size_t)i * bins + j;
+            float total = 0.0f, r = 0.0f, g = 0.0f, b = 0.0f;
+            for (int c = 0; c < num_classes; c++) {
+                uint32_t n = counts[c * plane + cell];
+                if (n == 0) continue;
+                total += n;
+                r += n * class_info[c].r;
+                g += n * class_info[c].g;
+                b += n * class_info[c].b;
+            }
+            if (total == 0.0f) continue;
+            GLubyte* pixel = &image[((size_t)j * bins + i) * 4];
+            pixel[0] = (GLubyte)(r / total * 255.0f + 0.5f);
+            pixel[1] = (GLubyte)(g / total * 255.0f + 0.5f);
+            pixel[2] = (GLubyte)(b / total * 255.0f + 0.5f);
+            pixel[3] = (GLubyte)((0.2f + 0.8f * logf(1.0f + total) / log_max) * 255.0f + 0.5f);
+        }
+    }
+    free(counts);
+    *bins_out = bins;
+    return image;
+}
+
+// Builds queued density images one at a time, off the GLUT thread
+void* scatter_worker(void* arg) {
+    ScatterCache* cache = (ScatterCache*)arg;
+    pthread_mutex_lock(&cache->lock);
+    for (;;) {
+        ScatterEntry* entry = NULL;
+        for (int i = 0; i < SCATTER_CACHE_SLOTS && entry == NULL; i++) {
+            if (cache->entries[i].state == SCATTER_QUEUED) entry = &cache->entries[i];
+        }
+        if (entry == NULL) {
+            pthread_cond_wait(&cache->wake, &cache->lock);
+            continue;
+        }
+        entry->state = SCATTER_BUILDING;
+        int axis_x = entry->axis_x, axis_y = entry->axis_y, generation = cache->generation;
+        pthread_mutex_unlock(&cache->lock);
+
+        int bins = 0;
+        pthread_mutex_lock(&cache->build_lock);
+        GLubyte* image = build_scatter_image(global_data, axis_x, axis_y, SCATTER_MAX_BINS, &bins);
+        pthread_mutex_unlock(&cache->build_lock);
+
+        pthread_mutex_lock(&cache->lock);
+        if (generation == cache->generation && entry->state == SCATTER_BUILDING && image != NULL) {
+            entry->image = image;
+            entry->bins = bins;
+            entry->bytes = (size_t)bins * bins * 4;
+            entry->state = SCATTER_READY;
+            cache->used += entry->bytes;
+        } else {
+            if (generation == cache->generation && entry->state == SCATTER_BUILDING) entry->state = SCATTER_EMPTY;
+            free(image);
+        }
+    }
+    return NULL;
+}
+
+// Releases an entry's memory and GL texture; needs the scatter window's context
+void release_scatter_entry(ScatterCache* cache, ScatterEntry* entry) {
+    if (entry->state == SCATTER_READY) cache->used -= entry->bytes;
+    if (entry->texture) glDeleteTextures(1, &entry->texture);
+    free(entry->vertices);
+    free(entry->colors);
+    free(entry->image);
+    memset(entry, 0, sizeof(ScatterEntry));
+}
+
+// Drops every cached pair, e.g. after the data changed. GL objects are released
+// by the next draw_scatter_plot, where the scatter window's context is current.
+void scatter_cache_clear() {
+    pthread_mutex_lock(&scatter_cache.lock);
+    scatter_cache.generation++;
+    scatter_cache.flush = true;
+    pthread_mutex_unlock(&scatter_cache.lock);
+}
+
+// Redraws the scatter window once queued builds finish, then stops polling
+void scatter_poll(int value) {
+    bool pending = false, ready = false;
+    pthread_mutex_lock(&scatter_cache.lock);
+    for (int i = 0; i < SCATTER_CACHE_SLOTS; i++) {
+        ScatterEntry* entry = &scatter_cache.entries[i];
+        if (entry->state == SCATTER_QUEUED || entry->state == SCATTER_BUILDING) pending = true;
+        if (entry->state == SCATTER_READY && entry->image != NULL) ready = true;
+    }
+    scatter_cache.polling = pending;
+    pthread_mutex_unlock(&scatter_cache.lock);
+
+    if (ready) post_scatter_redisplay();
+    if (pending) glutTimerFunc(50, scatter_poll, 0);
+}
+
+// Point arrays of a pair, built inline since they are cheap at this size
+bool build_scatter_points(ScatterEntry* entry, Dataset* ds) {
+    entry->vertices = (float*)malloc((ds->rows > 0 ? ds->rows : 1) * 2 * sizeof(float));
+    entry->colors = (GLubyte*)malloc((ds->rows > 0 ? ds->rows : 1) * 3);
+    if (entry->vertices == NULL || entry->colors == NULL) return false;
+    int n = 0;
+    for (int row = 0; row < ds->rows; row++) {
+        float x = dataset_value(ds, entry->axis_x, row);
+        float y = dataset_value(ds, entry->axis_y, row);
+        if (isnan(x) || isnan(y)) continue; // Rows missing either value have no point
+        const ClassInfo* info = &class_info[ds->class_ids[row]];
+        entry->vertices[n * 2] = x;
+        entry->vertices[n * 2 + 1] = y;
+        entry->colors[n * 3] = (GLubyte)(info->r * 255.0f + 0.5f);
+        entry->colors[n * 3 + 1] = (GLubyte)(info->g * 255.0f + 0.5f);
+        entry->colors[n * 3 + 2] = (GLubyte)(info->b * 255.0f + 0.5f);
+        n++;
+    }
+    entry->num_points = n;
+    entry->bytes = (size_t)ds->rows * 11;
+    return true;
+}
+
+// Returns the entry of an axis pair, creating it when missing: point arrays
+// are built right away, density images are queued for the worker (or built
+// inline when rendering offscreen). Least recently used ready entries are
+// evicted to stay within the budget. Call with the scatter context current.
+ScatterEntry* scatter_cache_get(int axis_x, int axis_y) {
+    ScatterCache* cache = &scatter_cache;
+    pthread_mutex_lock(&cache->lock);
+    if (cache->flush) {
+        for (int i = 0; i < SCATTER_CACHE_SLOTS; i++) release_scatter_entry(cache, &cache->entries[i]);
+        cache->used = 0;
+        cache->flush = false;
+    }
+
+    ScatterEntry* entry = NULL;
+    for (int i = 0; i < SCATTER_CACHE_SLOTS && entry == NULL; i++) {
+        ScatterEntry* e = &cache->entries[i];
+        if (e->state != SCATTER_EMPTY && e->axis_x == axis_x && e->axis_y == axis_y) entry = e;
+    }
+    if (entry != NULL) {
+        entry->last_used = ++cache->clock;
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
+    }
+
+    // Make room: a free slot, and used bytes under the budget for the new entry
+    bool points = global_rows <= SCATTER_POINT_ROWS && global_data->tiles == NULL;
+    size_t needed = points ? (size_t)global_rows * 11 : (size_t)SCATTER_MAX_BINS * SCATTER_MAX_BINS * 4;
+    for (;;) {
+        ScatterEntry* free_slot = NULL;
+        ScatterEntry* oldest = NULL;
+        for (int i = 0; i < SCATTER_CACHE_SLOTS; i++) {
+            ScatterEntry* e = &cache->entries[i];
+            if (e->state == SCATTER_EMPTY && free_slot == NULL) free_slot = e;
+            if (e->state == SCATTER_READY && (oldest == NULL || e->last_used < oldest->last_used)) oldest = e;
+        }
+        if (free_slot != NULL && (cache->used + needed <= SCATTER_CACHE_BUDGET || oldest == NULL)) {
+            entry = free_slot;
+            break;
+        }
+        if (oldest == NULL) break;
+        release_scatter_entry(cache, oldest);
+    }
+    if (entry == NULL) {
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    entry->axis_x = axis_x;
+    entry->axis_y = axis_y;
+    entry->last_used = ++cache->clock;
+
+    if (points || headless) {
+        bool ok = points ? build_scatter_points(entry, global_data)
+                         : (entry->image = build_scatter_image(global_data, axis_x, axis_y, SCATTER_MAX_BINS, &entry->bins)) != NULL;
+        if (!ok) {
+            release_scatter_entry(cache, entry);
+            pthread_mutex_unlock(&cache->lock);
+            return NULL;
+        }
+        if (!points) entry->bytes = (size_t)entry->bins * entry->bins * 4;
+        entry->state = SCATTER_READY;
+        cache->used += entry->bytes;
+    } else {
+        entry->state = SCATTER_QUEUED;
+        if (!cache->worker_started) {
+            cache->worker_started = pthread_create(&cache->worker, NULL, scatter_worker, cache) == 0;
+            if (cache->worker_started) pthread_detach(cache->worker);
+        }
+        pthread_cond_signal(&cache->wake);
+        if (!cache->polling) {
+            cache->polling = true;
+            glutTimerFunc(50, scatter_poll, 0);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+// Queues every pair of neighboring axes, the pairs hovering can select, so
+// their density images are ready before the cursor gets there
+void prefetch_scatter_pairs() {
+    if ((global_rows <= SCATTER_POINT_ROWS && global_data->tiles == NULL) || headless) return;
+    int window = glutGetWindow();
+    glutSetWindow(scatter_plot_window);
+    for (int col = 0, previous = -1; col < global_cols; col++) {
+        if (col == global_class_col_index) continue;
+        if (previous >= 0) scatter_cache_get(previous, col);
+        previous = col;
+    }
+    if (window) glutSetWindow(window);
+}
+
+// Draws a ready entry into [0, 1] x [0, 1], uploading a finished image first
+void draw_scatter_entry(ScatterEntry* entry) {
+    pthread_mutex_lock(&scatter_cache.lock);
+    bool ready = entry->state == SCATTER_READY;
+    if (ready && entry->image != NULL) {
+        glGenTextures(1, &entry->texture);
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, entry->bins, entry->bins, 0, GL_RGBA, GL_UNSIGNED_BYTE, entry->image);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        free(entry->image);
+        entry->image = NULL;
+    }
+    pthread_mutex_unlock(&scatter_cache.lock);
+    if (!ready) return;
+
+    if (entry->num_points > 0) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, entry->vertices);
+        glColorPointer(3, GL_UNSIGNED_BYTE, 0, entry->colors);
+        glDrawArrays(GL_POINTS, 0, entry->num_points);
+        profile_count_vertices(entry->num_points);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    } else if (entry->texture) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, entry->texture);
+        glColor3f(1.0f, 1.0f, 1.0f);
         glBegin(GL_QUADS);
-            glVertex2f(x_start, y_start - i * vertical_offset);
-            glVertex2f(x_start + box_size, y_start - i * vertical_offset);
-            glVertex2f(x_start + box_size, y_start - box_size - i * vertical_offset);
-            glVertex2f(x_start, y_start - box_size - i * vertical_offset);
+            glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
+            glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, 0.0f);
+            glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+            glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, 1.0f);
         glEnd();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDisable(GL_TEXTURE_2D);
+        glDisable(GL_BLEND);
+    }
+}
 
-        // Set the color for the text (black)
-        glColor3f(0.0f, 0.0f, 0.0f);
+// Scatter plot matrix of every pair of numeric axes. Cells are per-class
+// histograms binned by the worker pool on a background thread; each one is
+// published as soon as it is done and uploaded by the next scatter redraw.
+#define SPLOM_MAX_BINS 64
+#define SPLOM_GRID_PIXELS 1024
+
+typedef struct {
+    int ready;          // Set atomically once bins and image are filled in
+    int bins;
+    GLubyte* image;     // Freed once uploaded into texture
+    GLuint texture;
+} SplomCell;
+
+typedef struct {
+    Dataset* ds;
+    int num_axes;
+    int* axes;          // Numeric columns in display order
+    int num_pairs;
+    SplomCell* cells;   // One per pair a < b, in pair_index order
+    int max_bins;
+    int cells_done;
+    bool cancel;
+    bool running;
+    pthread_t thread;
+} SplomView;
+
+SplomView splom_view;
+
+int splom_pair_index(SplomView* view, int a, int b) {
+    return a * (2 * view->num_axes - a - 1) / 2 + (b - a - 1);
+}
+
+void splom_cell_task(void* ctx, int task) {
+    SplomView* view = (SplomView*)ctx;
+    if (__atomic_load_n(&view->cancel, __ATOMIC_RELAXED)) return;
+    int a = 0;
+    while (task >= splom_pair_index(view, a + 1, a + 2)) a++;
+    int b = task - splom_pair_index(view, a, a + 1) + a + 1;
+
+    SplomCell* cell = &view->cells[task];
+    cell->image = build_scatter_image(view->ds, view->axes[a], view->axes[b], view->max_bins, &cell->bins);
+    __atomic_store_n(&cell->ready, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&view->cells_done, 1, __ATOMIC_RELEASE);
+}
+
+void* splom_thread(void* arg) {
+    SplomView* view = (SplomView*)arg;
+    run_parallel(view->num_pairs, splom_cell_task, view);
+    return NULL;
+}
+
+// Stops a running build and releases the cells; textures need the scatter context
+void free_splom_view(SplomView* view) {
+    if (view->running) {
+        __atomic_store_n(&view->cancel, true, __ATOMIC_RELAXED);
+        pthread_join(view->thread, NULL);
+    }
+    for (int i = 0; view->cells != NULL && i < view->num_pairs; i++) {
+        if (view->cells[i].texture) glDeleteTextures(1, &view->cells[i].texture);
+        free(view->cells[i].image);
+    }
+    free(view->cells);
+    free(view->axes);
+    memset(view, 0, sizeof(SplomView));
+}
+
+// Redraws the scatter window while matrix cells keep arriving
+void splom_poll(int value) {
+    int done = __atomic_load_n(&splom_view.cells_done, __ATOMIC_ACQUIRE);
+    if (splom_mode && done != value) post_scatter_redisplay();
+    if (splom_view.running && done < splom_view.num_pairs) glutTimerFunc(100, splom_poll, done);
+}
+
+// Starts binning all axis pairs of ds; offscreen renders wait for the result
+bool start_splom_build(SplomView* view, Dataset* ds) {
+    free_splom_view(view);
+    view->ds = ds;
+    view->axes = (int*)malloc((ds->cols > 0 ? ds->cols : 1) * sizeof(int));
+    if (view->axes == NULL) return false;
+    for (int col = 0; col < ds->cols; col++) {
+        if (col != ds->class_col_index) view->axes[view->num_axes++] = col;
+    }
+    view->num_pairs = view->num_axes * (view->num_axes - 1) / 2;
+    view->cells = (SplomCell*)calloc(view->num_pairs > 0 ? view->num_pairs : 1, sizeof(SplomCell));
+    if (view->cells == NULL) {
+        perror("Memory allocation failed for scatter plot matrix");
+        free_splom_view(view);
+        return false;
+    }
+    // Cells get about as many bins as they have pixels on a typical screen
+    view->max_bins = SPLOM_MAX_BINS;
+    while (view->max_bins > 8 && view->num_axes * view->max_bins > SPLOM_GRID_PIXELS) view->max_bins /= 2;
+
+    if (headless) {
+        run_parallel(view->num_pairs, splom_cell_task, view);
+        return true;
+    }
+    view->running = pthread_create(&view->thread, NULL, splom_thread, view) == 0;
+    if (!view->running) {
+        fprintf(stderr, "Failed to start the scatter plot matrix thread.\n");
+        return false;
+    }
+    glutTimerFunc(100, splom_poll, 0);
+    return true;
+}
+
+// Draws the matrix over [0, 1] x [0, 1]: column j holds axis j on x, row i
+// (from the top) axis i on y. Cells below the diagonal reuse the transposed
+// image of their mirror cell, and inverted axes flip the texture coordinates.
+void draw_splom() {
+    SplomView* view = &splom_view;
+    // Follow mode drops the matrix while it is hidden
+    if (view->ds == NULL && global_data != NULL && !loading) start_splom_build(view, global_data);
+    int n = view->num_axes;
+    if (n < 2) return;
+    float size = 1.0f / n;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_TEXTURE_2D);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (i == j) continue;
+            int a = i < j ? i : j, b = i < j ? j : i;
+            SplomCell* cell = &view->cells[splom_pair_index(view, a, b)];
+            if (!__atomic_load_n(&cell->ready, __ATOMIC_ACQUIRE) || cell->bins == 0) continue;
+            if (cell->texture == 0) {
+                glGenTextures(1, &cell->texture);
+                glBindTexture(GL_TEXTURE_2D, cell->texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cell->bins, cell->bins, 0, GL_RGBA, GL_UNSIGNED_BYTE, cell->image);
+                free(cell->image);
+                cell->image = NULL;
+            }
+            glBindTexture(GL_TEXTURE_2D, cell->texture);
+
+            // The image has axes[a] along s and axes[b] along t
+            bool flip_x = axis_inverted[view->axes[j]], flip_y = axis_inverted[view->axes[i]];
+            float x0 = j * size, y0 = 1.0f - (i + 1) * size;
+            glBegin(GL_QUADS);
+            for (int corner = 0; corner < 4; corner++) {
+                float cx = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+                float cy = corner >= 2 ? 1.0f : 0.0f;
+                float vx = flip_x ? 1.0f - cx : cx, vy = flip_y ? 1.0f - cy : cy;
+                if (j < i) glTexCoord2f(vx, vy); else glTexCoord2f(vy, vx);
+                glVertex2f(x0 + cx * size, y0 + cy * size);
+            }
+            glEnd();
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+
+    // Grid lines, and the axis names on the diagonal
+    glColor3f(0.6f, 0.6f, 0.6f);
+    glBegin(GL_LINES);
+    for (int k = 1; k < n; k++) {
+        glVertex2f(k * size, 0.0f);
+        glVertex2f(k * size, 1.0f);
+        glVertex2f(0.0f, k * size);
+        glVertex2f(1.0f, k * size);
+    }
+    glEnd();
+    glColor3f(0.0f, 0.0f, 0.0f);
+    for (int k = 0; k < n; k++) {
+        char label[50];
+        sprintf(label, "Axis %d", view->axes[k] + 1);
+        renderBitmapString(k * size + size * 0.1f, 1.0f - (k + 0.5f) * size, GLUT_BITMAP_HELVETICA_12, label);
+    }
+}
+
+void initScatterPlot() {
+    // Set up any specific OpenGL state for the scatter plot window
+    glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
+    glEnable(GL_POINT_SMOOTH);
+    glPointSize(5.0f); // Set a visible size for points
+}
+
+void draw_scatter_plot() {
+    if (!splom_mode && (closest_axis1 == -1 || closest_axis2 == -1)) return; // Ensure axes are selected
+    double profile_time = profile_start();
+
+    // Clear with white background
+    glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Set up orthographic projection for the scatter plot
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, 1, 0, 1); // Coordinate range [0, 1] for both x and y
+
+    // Set modelview matrix
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    if (splom_mode) {
+        draw_splom();
+        present_frame();
+        profile_end(STAGE_SCATTER_PLOT, profile_time);
+        return;
+    }
+
+    // Draw axes
+    glColor3f(0.0f, 0.0f, 0.0f); // Black color for axes
+    glBegin(GL_LINES);
+        // X-axis
+        glVertex2f(0.001f, 0.001f); // Start at bottom left corner
+        glVertex2f(1.0f, 0.001f); // End at bottom right corner
+        // Y-axis
+        glVertex2f(0.001f, 0.001f); // Start at bottom left corner
+        glVertex2f(0.001f, 1.0f); // End at top left corner
+    glEnd();
+
+    // Label axes
+    char axis1_label[50], axis2_label[50];
+    sprintf(axis1_label, "Axis %d", closest_axis1 + 1);
+    sprintf(axis2_label, "Axis %d", closest_axis2 + 1);
+    renderBitmapString(0.01f, 0.48f, GLUT_BITMAP_HELVETICA_18, axis1_label); // X-axis label
+    renderBitmapString(0.48f, 0.01f, GLUT_BITMAP_HELVETICA_18, axis2_label);  // Y-axis label
+
+    // Draw the cached points or density image of the two closest axes; pairs
+    // are cached in ascending order, so the other order is drawn transposed
+    ScatterEntry* entry = scatter_cache_get(closest_axis1 < closest_axis2 ? closest_axis1 : closest_axis2,
+                                            closest_axis1 < closest_axis2 ? closest_axis2 : closest_axis1);
+    if (entry != NULL) {
+        if (closest_axis1 > closest_axis2) {
+            const GLfloat transpose[16] = { 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+            glMultMatrixf(transpose);
+        }
+        draw_scatter_entry(entry);
+    }
+
+    // Swap the buffers to display the scatter plot
+    present_frame();
+    profile_end(STAGE_SCATTER_PLOT, profile_time);
+}
+
+#ifndef _WIN32
+EGLDisplay egl_display = EGL_NO_DISPLAY;
+EGLSurface egl_surface = EGL_NO_SURFACE;
+EGLContext egl_context = EGL_NO_CONTEXT;
+#endif
+
+// Creates a desktop OpenGL context on a width x height pbuffer, without a window system
+bool create_offscreen_context(int width, int height) {
+#ifdef _WIN32
+    fprintf(stderr, "Offscreen rendering needs EGL, which is not available on this platform.\n");
+    return false;
+#else
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display != NULL) {
+        egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+#endif
+    if (egl_display == EGL_NO_DISPLAY) egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL)) {
+        fprintf(stderr, "Failed to initialize EGL (error 0x%x).\n", eglGetError());
+        return false;
+    }
 
-        // Render the class name next to the box
-        renderBitmapString(x_start + box_size + 0.01f, y_start - box_size/2 - i * vertical_offset, GLUT_BITMAP_HELVETICA_12, class_info[i].class_name);
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    const EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs) || num_configs == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "No EGL config supports offscreen desktop OpenGL.\n");
+        return false;
+    }
+    egl_surface = eglCreatePbufferSurface(egl_display, config, surface_attribs);
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, NULL);
+    if (egl_surface == EGL_NO_SURFACE || egl_context == EGL_NO_CONTEXT || !eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+        fprintf(stderr, "Failed to create a %dx%d offscreen surface (error 0x%x).\n", width, height, eglGetError());
+        return false;
     }
+    return true;
+#endif
 }
 
-void display() {
-    // Clear the color buffer
-    glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+void destroy_offscreen_context() {
+#ifndef _WIN32
+    if (egl_display == EGL_NO_DISPLAY) return;
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl_context != EGL_NO_CONTEXT) eglDestroyContext(egl_display, egl_context);
+    if (egl_surface != EGL_NO_SURFACE) eglDestroySurface(egl_display, egl_surface);
+    eglTerminate(egl_display);
+    egl_display = EGL_NO_DISPLAY;
+#endif
+}
 
-    // Set up the viewport
-    int width = glutGet(GLUT_WINDOW_WIDTH);
-    int height = glutGet(GLUT_WINDOW_HEIGHT);
-    glViewport(0, 0, width, height);
+uint32_t crc_table[256];
 
-    // Set up the orthographic projection with a small margin
-    float margin = 0.05f; // Margin percentage of the screen size
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    float aspect = width > height ? (float)width / height : (float)height / width;
-    // Apply the scale here, making sure it affects both x and y uniformly
-    glOrtho(-margin * aspect * scale, (1.0f + margin) * aspect * scale, -margin * scale, (1.0f + margin) * scale, -1.0, 1.0);
+uint32_t crc32_update(uint32_t crc, const unsigned char* bytes, size_t length) {
+    uint32_t* table = crc_table;
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
 
-    // Switch back to the modelview matrix
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+void write_be32(unsigned char* out, uint32_t value) {
+    out[0] = value >> 24; out[1] = value >> 16; out[2] = value >> 8; out[3] = value;
+}
 
-    // Apply translation and scaling transformations
-    glPushMatrix();
-    glTranslatef(translate_x, translate_y, 0.0f);
+// Writes one chunk: length, type, data and CRC. Returns false on a short write.
+bool write_png_chunk(FILE* file, const char* type, const unsigned char* data, uint32_t length) {
+    unsigned char header[8];
+    write_be32(header, length);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = crc32_update(crc32_update(0, header + 4, 4), data, length);
+    unsigned char footer[4];
+    write_be32(footer, crc);
+    return fwrite(header, 1, 8, file) == 8 &&
+           (length == 0 || fwrite(data, 1, length, file) == length) &&
+           fwrite(footer, 1, 4, file) == 4;
+}
 
-    // Draw parallel coordinates
-    if (global_data != NULL && class_info != NULL && density != NULL) {
-        draw_parallel_coordinates(global_data, global_rows, global_cols, global_class_col_index, class_info, num_classes, density);
+// Writes top-down RGB pixels as a PNG using stored (uncompressed) deflate blocks,
+// which keeps the writer free of a zlib dependency
+bool write_png(FILE* file, const unsigned char* pixels, int width, int height) {
+    size_t row_bytes = (size_t)width * 3 + 1; // Filter byte plus pixels
+    size_t raw_size = row_bytes * height;
+    size_t num_blocks = (raw_size + 65534) / 65535;
+    unsigned char* idat = (unsigned char*)malloc(2 + raw_size + num_blocks * 5 + 4);
+    unsigned char* raw = (unsigned char*)malloc(raw_size);
+    if (idat == NULL || raw == NULL) {
+        free(idat);
+        free(raw);
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
+        raw[y * row_bytes] = 0;
+        memcpy(raw + y * row_bytes + 1, pixels + (size_t)y * width * 3, (size_t)width * 3);
     }
 
-    // Draw axis for each attribute
-    draw_axes(global_cols);
-    draw_bounding_box();
-    
-    // Draw stars for inverted axes
-    for (int col = 0; col < global_cols; col++) {
-        if (col == global_class_col_index) continue; // Skip the 'class' column
+    size_t length = 0;
+    idat[length++] = 0x78;
+    idat[length++] = 0x01;
+    uint32_t a = 1, b = 0;
+    for (size_t offset = 0; offset < raw_size; offset += 65535) {
+        uint32_t block = raw_size - offset < 65535 ? (uint32_t)(raw_size - offset) : 65535;
+        idat[length++] = offset + block == raw_size; // Final block flag, stored type
+        idat[length++] = block & 0xFF;
+        idat[length++] = block >> 8;
+        idat[length++] = ~block & 0xFF;
+        idat[length++] = (~block >> 8) & 0xFF;
+        memcpy(idat + length, raw + offset, block);
+        length += block;
+        for (uint32_t i = 0; i < block; i++) {
+            a = (a + raw[offset + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    write_be32(idat + length, (b << 16) | a);
+    length += 4;
+
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    unsigned char ihdr[13] = { 0 };
+    write_be32(ihdr, width);
+    write_be32(ihdr + 4, height);
+    ihdr[8] = 8; // Bit depth
+    ihdr[9] = 2; // Truecolor
+    bool ok = fwrite(signature, 1, 8, file) == 8 &&
+              write_png_chunk(file, "IHDR", ihdr, 13) &&
+              write_png_chunk(file, "IDAT", idat, (uint32_t)length) &&
+              write_png_chunk(file, "IEND", NULL, 0);
+    free(idat);
+    free(raw);
+    return ok;
+}
 
-        if (axis_inverted[col]) {
-            float x = (col / (float)(global_cols - 1)) * stretch_factor_x;
-            float y = -0.05f; // Position below the axis line
-            draw_star(x, y, 0.01f); // Adjust the size as needed
+// Reads the current frame back and writes it as PNG or, for any other extension, binary PPM
+bool save_frame(const char* filename, int width, int height) {
+    unsigned char* pixels = (unsigned char*)malloc((size_t)width * height * 3);
+    unsigned char* flipped = (unsigned char*)malloc((size_t)width * height * 3);
+    if (pixels == NULL || flipped == NULL) {
+        perror("Memory allocation failed for frame readback");
+        free(pixels);
+        free(flipped);
+        return false;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    for (int y = 0; y < height; y++) {
+        memcpy(flipped + (size_t)y * width * 3, pixels + (size_t)(height - 1 - y) * width * 3, (size_t)width * 3);
+    }
+
+    bool ok = false;
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        perror("Error opening output image");
+    } else {
+        const char* ext = strrchr(filename, '.');
+        if (ext != NULL && (strcmp(ext, ".png") == 0 || strcmp(ext, ".PNG") == 0)) {
+            ok = write_png(file, flipped, width, height);
+        } else {
+            fprintf(file, "P6\n%d %d\n255\n", width, height);
+            ok = fwrite(flipped, 1, (size_t)width * height * 3, file) == (size_t)width * height * 3;
         }
+        if (fclose(file) != 0) ok = false;
+        if (!ok) fprintf(stderr, "Failed to write %s.\n", filename);
     }
+    free(pixels);
+    free(flipped);
+    return ok;
+}
 
-    // Reset the line width back to default if you changed it
-    glLineWidth(1.0f);
+// Renders the parallel coordinates to filename and the scatter plot of the first two
+// axes to the same name with a _scatter suffix, timing every stage
+bool render_offscreen(const char* filename) {
+    double start_time = get_time_seconds();
+    if (!create_offscreen_context(headless_width, headless_height)) return false;
+    printf("Render stage %-16s %9.3f ms\n", "context", (get_time_seconds() - start_time) * 1000.0);
+
+    init();
+    if (!aggregate_mode && global_data->tiles == NULL) {
+        start_time = get_time_seconds();
+        build_polyline_buffers(&pc_buffers, global_data, class_info, density);
+        printf("Render stage %-16s %9.3f ms\n", "polyline buffers", (get_time_seconds() - start_time) * 1000.0);
+    }
 
-    draw_legend();
+    start_time = get_time_seconds();
+    display();
+    printf("Render stage %-16s %9.3f ms\n", "parallel coords", (get_time_seconds() - start_time) * 1000.0);
 
-    glPopMatrix();
-    glutSwapBuffers();
+    start_time = get_time_seconds();
+    bool ok = save_frame(filename, headless_width, headless_height);
+    printf("Render stage %-16s %9.3f ms\n", "readback + write", (get_time_seconds() - start_time) * 1000.0);
+
+    // The scatter plot has its own window, and so its own GL state, in the GUI
+    for (int col = 0; col < global_cols && closest_axis2 == -1; col++) {
+        if (col == global_class_col_index) continue;
+        if (closest_axis1 == -1) closest_axis1 = col; else closest_axis2 = col;
+    }
+    if (ok && closest_axis2 != -1) {
+        size_t length = strlen(filename);
+        const char* ext = strrchr(filename, '.');
+        if (ext == NULL || strchr(ext, '/') != NULL) ext = filename + length;
+        char* scatter_name = (char*)malloc(length + 9);
+        if (scatter_name == NULL) return false;
+        sprintf(scatter_name, "%.*s_scatter%s", (int)(ext - filename), filename, ext);
+
+        glDisable(GL_LINE_SMOOTH);
+        glDisable(GL_BLEND);
+        initScatterPlot();
+        start_time = get_time_seconds();
+        draw_scatter_plot();
+        printf("Render stage %-16s %9.3f ms\n", "scatter plot", (get_time_seconds() - start_time) * 1000.0);
+
+        start_time = get_time_seconds();
+        ok = save_frame(scatter_name, headless_width, headless_height);
+        printf("Render stage %-16s %9.3f ms\n", "readback + write", (get_time_seconds() - start_time) * 1000.0);
+        if (ok) printf("Wrote %s and %s\n", filename, scatter_name);
+        free(scatter_name);
+    }
+
+    free_polyline_buffers(&pc_buffers);
+    free_aggregate_view(&aggregate_view);
+    destroy_offscreen_context();
+    return ok;
 }
 
-void init() {
-    // Enable line smoothing
-    glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+// Points the globals the views work on at a freshly loaded dataset and drops
+// everything derived from the previous one. Axis inversions survive when the
+// column count stays, as when the final dataset replaces a loading preview.
+void set_global_dataset(Dataset* ds) {
+    global_data = ds;
+    class_info = class_dict.class_info;
+    num_classes = class_dict.num_classes;
+    global_rows = ds->rows;
+    if (axis_inverted == NULL || global_cols != ds->cols) {
+        free(axis_inverted);
+        axis_inverted = (bool*)calloc(ds->cols, sizeof(bool));
+    }
+    global_cols = ds->cols;
+    global_class_col_index = ds->class_col_index;
+    hovered_row = -1;
+    drawn_rows = 0;
+    pc_buffers.dirty = true;
+    pick_index.dirty = true;
+    free_aggregate_view(&aggregate_view);
+    static_layer.dirty = true;
+    scatter_cache_clear();
+    refresh_brushes();
 }
 
-void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-        int width = glutGet(GLUT_WINDOW_WIDTH);
-        //int height = glutGet(GLUT_WINDOW_HEIGHT);
-        float normalized_x = (float)x / (float)width;
-        float axis_space = 1.0f / (global_cols - 1);
+// Loading runs on a background thread in the GUI. After every parsed batch the
+// loader publishes a small normalized sample of the rows so far, which the GUI
+// shows until the full dataset, normalized and with densities, replaces it.
+#define PREVIEW_ROWS 100000
+#define PREVIEW_INTERVAL 0.25 // Seconds between two previews
 
-        // Determine which axis was clicked
-        for (int i = 0; i < global_cols; ++i) {
-            if (i == global_class_col_index) continue; // Skip class column
-            float axis_x = i * axis_space;
-            if (normalized_x >= axis_x - axis_space / 2 && normalized_x < axis_x + axis_space / 2) {
-                // Invert the axis
-                axis_inverted[i] = !axis_inverted[i];
-                glutPostRedisplay(); // Request to redraw the graph
-                break;
-            }
+typedef struct {
+    Dataset* ds;           // Every k-th row parsed so far, normalized on its own range
+    ClassInfo* classes;    // Class table at that point; names stay owned by class_dict
+    int num_classes;
+    float* density;
+} LoadPreview;
+
+typedef struct {
+    const char* csv_file;
+    bool use_cache;
+    bool progressive;      // Publish previews while parsing
+    // Results, handed to the globals by finish_loading
+    Dataset* ds;
+    float* min_vals;
+    float* max_vals;
+    float* density;
+    uint8_t* density_levels;
+    int* sample_order;
+    bool density_in_cache;
+    bool ok;
+    double stage_seconds[NUM_STAGES]; // Load stage times, profiled by finish_loading on the GUI thread
+    // Shared with the GUI under lock
+    pthread_mutex_t lock;
+    LoadPreview* preview;  // Newest preview the GUI has not taken yet
+    size_t bytes_done, bytes_total;
+    int rows_loaded;
+    bool done;
+    double last_preview;
+    pthread_t thread;
+} LoadJob;
+
+LoadJob load_job = { .lock = PTHREAD_MUTEX_INITIALIZER };
+LoadPreview* shown_preview = NULL; // Preview the views currently point at
+
+void free_load_preview(LoadPreview* preview) {
+    if (preview == NULL) return;
+    dataset_free(preview->ds);
+    free(preview->classes);
+    free(preview->density);
+    free(preview);
+}
+
+// Copies every step-th row of ds into a normalized preview with densities
+LoadPreview* build_load_preview(Dataset* ds, ClassDict* classes) {
+    int step = (ds->rows + PREVIEW_ROWS - 1) / PREVIEW_ROWS;
+    int rows = (ds->rows + step - 1) / step;
+    LoadPreview* preview = (LoadPreview*)calloc(1, sizeof(LoadPreview));
+    if (preview == NULL) return NULL;
+    preview->ds = dataset_create(ds->cols, ds->class_col_index, rows);
+    preview->classes = (ClassInfo*)malloc((classes->num_classes > 0 ? classes->num_classes : 1) * sizeof(ClassInfo));
+    preview->density = (float*)malloc((size_t)rows * ds->cols * sizeof(float));
+    if (preview->ds == NULL || preview->classes == NULL || preview->density == NULL) {
+        free_load_preview(preview);
+        return NULL;
+    }
+
+    Dataset* sample = preview->ds;
+    for (int col = 0; col < ds->cols; col++) {
+        if (col == ds->class_col_index) continue;
+        for (int i = 0; i < rows; i++) {
+            sample->columns[col][i] = ds->columns[col][(size_t)i * step];
+            column_stats_add(&sample->stats[col], sample->columns[col][i]);
         }
     }
-    
-    if (button == GLUT_RIGHT_BUTTON) {
-        if (state == GLUT_DOWN && !drawing_box) {
-            // First right-click: Start drawing the bounding box
-            window_to_world(x, y, &box_start_x, &box_start_y);
-            box_end_x = box_start_x; // Initialize to the start values
-            box_end_y = box_start_y;
-            drawing_box = true;
-            box_drawn = false;
-        } else if (state == GLUT_DOWN && drawing_box) {
-            // Second right-click: Finalize the bounding box
-            window_to_world(x, y, &box_end_x, &box_end_y);
-            drawing_box = false;
-            box_drawn = true;
-            check_intersections_and_print_counts();
+    for (int i = 0; i < rows; i++) sample->class_ids[i] = ds->class_ids[(size_t)i * step];
+    sample->rows = rows;
+    // Categorical codes keep the positions of the full dataset
+    if (ds->categorical) {
+        sample->categorical = (bool*)malloc(ds->cols * sizeof(bool));
+        if (sample->categorical == NULL) {
+            free_load_preview(preview);
+            return NULL;
+        }
+        memcpy(sample->categorical, ds->categorical, ds->cols * sizeof(bool));
+        for (int col = 0; col < ds->cols; col++) {
+            if (ds->categorical[col] && sample->stats[col].count > 0) sample->stats[col].max = ds->stats[col].max;
         }
-        glutPostRedisplay();
     }
+
+    float min_vals[ds->cols], max_vals[ds->cols];
+    normalize_data(sample, min_vals, max_vals);
+    calculate_density(sample, preview->density);
+    memcpy(preview->classes, classes->class_info, classes->num_classes * sizeof(ClassInfo));
+    preview->num_classes = classes->num_classes;
+    assign_colors(preview->classes, preview->num_classes);
+    return preview;
 }
 
-void calculate_density(float** data, int rows, int cols, float* density) {
-    // Initialize densities to 0
-    memset(density, 0, sizeof(float) * rows * cols);
+// LoadProgress callback: reports progress and, every PREVIEW_INTERVAL, a new preview
+bool publish_load_preview(void* ctx, Dataset* ds, ClassDict* classes, size_t bytes_done, size_t bytes_total) {
+    LoadJob* job = (LoadJob*)ctx;
+    LoadPreview* preview = NULL;
+    double now = get_time_seconds();
+    if (bytes_done < bytes_total && ds->rows > 0 && now - job->last_preview >= PREVIEW_INTERVAL) {
+        preview = build_load_preview(ds, classes); // Optional, loading goes on without it
+        job->last_preview = get_time_seconds();
+    }
 
-    // Define brush size or the distance within which to consider points
-    float brush_size = 0.01f;
+    pthread_mutex_lock(&job->lock);
+    job->bytes_done = bytes_done;
+    job->bytes_total = bytes_total;
+    job->rows_loaded = ds->rows;
+    if (preview != NULL) {
+        free_load_preview(job->preview); // Never shown, a newer one is ready
+        job->preview = preview;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return true;
+}
 
-    for (int col = 0; col < cols; col++) {
-        for (int i = 0; i < rows; i++) {
-            for (int j = 0; j < rows; j++) {
-                if (i != j && fabs(data[i][col] - data[j][col]) < brush_size) {
-                    density[i * cols + col]++;
-                }
-            }
+// LoadProgress callback of out-of-core loads: appends the complete tiles of
+// the rows parsed so far to the tile file and keeps only the rest in memory
+bool spill_load_tiles(void* ctx, Dataset* ds, ClassDict* classes, size_t bytes_done, size_t bytes_total) {
+    LoadJob* job = (LoadJob*)ctx;
+    if (ds->tiles == NULL) ds->tiles = tile_store_create(job->csv_file, ds->cols, ds->class_col_index, memory_budget);
+    if (ds->tiles == NULL) return false;
+    int spilled = 0;
+    for (; ds->rows - spilled >= TILE_ROWS; spilled += TILE_ROWS) {
+        if (!tile_store_append(ds->tiles, ds, spilled, TILE_ROWS)) return false;
+    }
+    int rest = ds->rows - spilled;
+    if (spilled > 0 && rest > 0) {
+        for (int col = 0; col < ds->cols; col++) {
+            if (col != ds->class_col_index) memmove(ds->columns[col], ds->columns[col] + spilled, rest * sizeof(float));
         }
+        memmove(ds->class_ids, ds->class_ids + spilled, rest * sizeof(int));
     }
+    ds->rows = rest;
+
+    pthread_mutex_lock(&job->lock);
+    job->bytes_done = bytes_done;
+    job->bytes_total = bytes_total;
+    job->rows_loaded = ds->tiles->rows + ds->rows;
+    pthread_mutex_unlock(&job->lock);
+    return true;
 }
 
-void mouse_motion(int x, int y) {
-    // Convert window coordinates to world coordinates
-    float world_x, world_y;
-    window_to_world(x, y, &world_x, &world_y);
+// Out-of-core load (--out-of-core): parses the CSV batch by batch into the tile
+// file, so memory holds one batch at a time, then derives the column maps from
+// the statistics gathered while parsing and the density profiles in one
+// streaming pass. There is no cache file and no sample order.
+bool load_tiled_dataset(LoadJob* job) {
+    double stage_time = get_time_seconds();
+    Dataset* ds = job->ds = load_csv(job->csv_file, &class_dict, spill_load_tiles, job);
+    if (ds == NULL) {
+        fprintf(stderr, "Failed to load data.\n");
+        return false;
+    }
+    if (ds->tiles == NULL) ds->tiles = tile_store_create(job->csv_file, ds->cols, ds->class_col_index, memory_budget);
+    if (ds->tiles == NULL || (ds->rows > 0 && !tile_store_append(ds->tiles, ds, 0, ds->rows))) {
+        fprintf(stderr, "Failed to write the tile file.\n");
+        return false;
+    }
 
-    // Find the two closest axes
-    closest_axis1 = -1;
-    closest_axis2 = -1;
-    float min_distance1 = FLT_MAX;
-    float min_distance2 = FLT_MAX;
+    // Every row is in the tiles now
+    for (int col = 0; col < ds->cols; col++) {
+        aligned_free(ds->columns[col]);
+        ds->columns[col] = NULL;
+    }
+    aligned_free(ds->class_ids);
+    ds->class_ids = NULL;
+    ds->capacity = 0;
+    ds->rows = ds->tiles->rows;
+    job->stage_seconds[STAGE_LOAD] += get_time_seconds() - stage_time;
+
+    stage_time = get_time_seconds();
+    job->min_vals = (float*)malloc(ds->cols * sizeof(float));
+    job->max_vals = (float*)malloc(ds->cols * sizeof(float));
+    if (job->min_vals == NULL || job->max_vals == NULL) {
+        fprintf(stderr, "Failed to allocate memory for column ranges.\n");
+        return false;
+    }
+    normalize_data(ds, job->min_vals, job->max_vals);
+    if (ds->maps == NULL) return false;
+    job->stage_seconds[STAGE_NORMALIZE] += get_time_seconds() - stage_time;
+
+    stage_time = get_time_seconds();
+    if (!calculate_density_profile(ds)) return false;
+    job->stage_seconds[STAGE_DENSITY] += get_time_seconds() - stage_time;
+    printf("Out of core: %d tiles, page cache of %d pages (%zu MB)\n", (ds->rows + TILE_ROWS - 1) / TILE_ROWS,
+           ds->tiles->num_pages, ((size_t)ds->tiles->num_pages * TILE_ROWS * sizeof(float)) >> 20);
+    return true;
+}
 
-    for (int col = 0; col < global_cols; col++) {
-        if (col == global_class_col_index) continue;
+// Loads, normalizes and compacts the dataset and computes its densities
+bool load_dataset(LoadJob* job) {
+    bool write_new_cache = false;
+    if (out_of_core) return load_tiled_dataset(job);
+
+    // Reopen the binary cache when it is current, otherwise load and normalize the CSV
+    double stage_time = get_time_seconds();
+    job->ds = job->use_cache ? load_cache(job->csv_file, &class_dict, &job->min_vals, &job->max_vals, &job->density) : NULL;
+    job->density_in_cache = job->density != NULL;
+    if (job->ds == NULL) {
+        job->ds = load_csv(job->csv_file, &class_dict, job->progressive ? publish_load_preview : NULL, job);
+        if (job->ds == NULL) {
+            fprintf(stderr, "Failed to load data.\n");
+            return false;
+        }
+        job->stage_seconds[STAGE_LOAD] += get_time_seconds() - stage_time;
+        stage_time = get_time_seconds();
+        job->min_vals = (float*)malloc(job->ds->cols * sizeof(float));
+        job->max_vals = (float*)malloc(job->ds->cols * sizeof(float));
+        if (job->min_vals == NULL || job->max_vals == NULL) {
+            fprintf(stderr, "Failed to allocate memory for column ranges.\n");
+            return false;
+        }
+        normalize_data(job->ds, job->min_vals, job->max_vals);
+        job->stage_seconds[STAGE_NORMALIZE] += get_time_seconds() - stage_time;
+        write_new_cache = job->use_cache && !compact_mode;
+    } else {
+        job->stage_seconds[STAGE_LOAD] += get_time_seconds() - stage_time;
+    }
 
-        float axis_x = (float)col / (global_cols - 1);
-        float distance = fabs(world_x - axis_x);
+    // Compact mode trades the float columns and densities for 16-bit values and
+    // 8-bit levels; cached float densities are scaled down rather than recomputed
+    if (compact_mode) {
+        if (!compact_dataset(job->ds)) {
+            fprintf(stderr, "Failed to compact the dataset.\n");
+            return false;
+        }
+        if (job->density != NULL) {
+            job->density_levels = density_to_levels(job->ds, job->density);
+            job->density = NULL;
+            job->density_in_cache = false;
+        }
+    }
 
-        if (distance < min_distance1) {
-            min_distance2 = min_distance1;
-            closest_axis2 = closest_axis1;
-            min_distance1 = distance;
-            closest_axis1 = col;
-        } else if (distance < min_distance2) {
-            min_distance2 = distance;
-            closest_axis2 = col;
+    size_t cells = (size_t)job->ds->rows * job->ds->cols;
+    if (compact_mode && job->density_levels == NULL) {
+        job->density_levels = (uint8_t*)malloc(cells + 1);
+        if (!job->density_levels) {
+            fprintf(stderr, "Failed to allocate memory for density.\n");
+            return false;
+        }
+        stage_time = get_time_seconds();
+        calculate_density_levels(job->ds, job->density_levels);
+        job->stage_seconds[STAGE_DENSITY] += get_time_seconds() - stage_time;
+    } else if (!compact_mode && job->density == NULL) {
+        job->density = (float*)malloc(cells * sizeof(float));
+        if (!job->density) {
+            fprintf(stderr, "Failed to allocate memory for density.\n");
+            return false;
         }
+        stage_time = get_time_seconds();
+        calculate_density(job->ds, job->density);
+        job->stage_seconds[STAGE_DENSITY] += get_time_seconds() - stage_time;
+        write_new_cache = job->use_cache;
     }
+    if (write_new_cache) write_cache(job->csv_file, job->ds, &class_dict, job->min_vals, job->max_vals, job->density);
 
-    // Find the closest row (point) to the mouse position
-    hovered_row = -1;
-    float min_distance = FLT_MAX;
-    for (int row = 0; row < global_rows; row++) {
-        float x_pos = (float)closest_axis1 / (global_cols - 1);
-        float y_pos = global_data[row][closest_axis1];
+    // Optional, without it every frame draws all rows
+    if (!headless && job->ds->rows >= SAMPLE_MIN_ROWS) job->sample_order = build_sample_order(job->ds, class_dict.num_classes);
+    return true;
+}
 
-        float distance = sqrt((world_x - x_pos) * (world_x - x_pos) + (world_y - y_pos) * (world_y - y_pos));
-        if (distance < min_distance) {
-            min_distance = distance;
-            hovered_row = row;
-        }
+// Runs load_dataset, on the loader thread in the GUI and directly otherwise
+void* load_pipeline(void* arg) {
+    LoadJob* job = (LoadJob*)arg;
+    bool ok = load_dataset(job);
+    pthread_mutex_lock(&job->lock);
+    job->ok = ok;
+    job->done = true;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Hands the loaded dataset to the views, replacing any preview, and records
+// the load's stage times, as the profiler is only touched by the GUI thread
+void finish_loading(LoadJob* job) {
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        if (job->stage_seconds[stage] > 0.0) profile_record(stage, job->stage_seconds[stage]);
     }
+    density = job->density;
+    density_levels = job->density_levels;
+    density_in_cache = job->density_in_cache;
+    sample_order = job->sample_order;
+    sample_order_rows = sample_order != NULL ? job->ds->rows : 0;
+    set_global_dataset(job->ds);
+    if (global_rows > AGGREGATE_AUTO_ROWS || job->ds->tiles != NULL) aggregate_mode = true;
+    loading = false;
+}
+
+// Follow mode (--follow): the input is polled for appended lines, which are
+// parsed onto the end of the dataset. Rows keep the current column maps unless
+// some column's range grew; the sorted index, densities, polylines and density
+// bands are extended by the new rows rather than rebuilt.
+typedef struct {
+    const char* csv_file;
+    uint64_t offset;       // Input bytes consumed so far
+} FollowState;
 
-    // Request to redraw both windows
+FollowState follow_state;
+
+// Adds the records in [p, end) to the shown dataset and updates the views
+bool follow_append(const char* p, const char* end) {
+    Dataset* ds = global_data;
+    int old_rows = ds->rows, old_classes = class_dict.num_classes;
+    ColumnStats old_stats[ds->cols];
+    memcpy(old_stats, ds->stats, ds->cols * sizeof(ColumnStats));
+
+    // Stop the background readers of the dataset before its arrays move
     glutSetWindow(scatter_plot_window);
-    glutPostRedisplay();
+    free_splom_view(&splom_view);
+    pthread_mutex_lock(&scatter_cache.build_lock);
+    double stage_time = get_time_seconds();
+    bool ok = parse_records(p, end, ds, &class_dict);
+    profile_record(STAGE_LOAD, get_time_seconds() - stage_time);
+    bool renormalized = false;
+    if (ok && ds->rows > old_rows) {
+        stage_time = get_time_seconds();
+        renormalized = normalize_appended(ds, old_rows, old_stats);
+        profile_record(STAGE_NORMALIZE, get_time_seconds() - stage_time);
+        if (renormalized) free_sorted_index(ds); // Densities change everywhere, recount them
+        stage_time = get_time_seconds();
+        density = extend_density(ds, old_rows, density);
+        profile_record(STAGE_DENSITY, get_time_seconds() - stage_time);
+        ok = density != NULL;
+    }
+    pthread_mutex_unlock(&scatter_cache.build_lock);
+    if (!ok) {
+        fprintf(stderr, "Failed to add the appended rows.\n");
+        return false;
+    }
+    int added = ds->rows - old_rows;
+    if (added == 0) return true;
+
+    for (int col = 0; col < ds->cols; col++) {
+        load_job.min_vals[col] = ds->stats[col].count > 0 ? ds->stats[col].min : 0.0f;
+        load_job.max_vals[col] = ds->stats[col].count > 0 ? ds->stats[col].max : 0.0f;
+    }
+    // New classes shift every class color
+    if (class_dict.num_classes != old_classes) assign_colors(class_dict.class_info, class_dict.num_classes);
+    class_info = class_dict.class_info;
+    num_classes = class_dict.num_classes;
+    global_rows = ds->rows;
 
+    // Large appends are cheaper to draw from fresh buffers with fresh alpha scales
     glutSetWindow(parallel_coords_window);
-    glutPostRedisplay();
+    if (renormalized || class_dict.num_classes != old_classes || added > old_rows / 4 ||
+        !append_polyline_buffers(&pc_buffers, ds, class_info, density)) {
+        pc_buffers.dirty = true;
+    }
+    if (renormalized) free_aggregate_view(&aggregate_view); // Binned rows moved
+    pick_index.dirty = true;
+    static_layer.dirty = true;
+    scatter_cache_clear();
+    refresh_brushes();
+    if (splom_mode) start_splom_build(&splom_view, ds);
+    printf("Followed %d new rows, %d in total%s\n", added, ds->rows, renormalized ? ", renormalized" : "");
+    return true;
 }
 
-void initScatterPlot() {
-    // Set up any specific OpenGL state for the scatter plot window
-    glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
-    glEnable(GL_POINT_SMOOTH);
-    glPointSize(5.0f); // Set a visible size for points
+// Reads the complete lines appended to the input since the last poll. A load
+// that ended inside a line being written has parsed its start as a row, so
+// the rest of that line is skipped.
+void follow_poll(int value) {
+    FollowState* follow = &follow_state;
+    uint64_t size;
+    int64_t mtime;
+    if (!get_file_stamp(follow->csv_file, &size, &mtime) || size == follow->offset) {
+        glutTimerFunc(FOLLOW_INTERVAL_MS, follow_poll, 0);
+        return;
+    }
+    if (size < follow->offset) {
+        fprintf(stderr, "%s was truncated, no longer following it.\n", follow->csv_file);
+        return;
+    }
+
+    uint64_t start = follow->offset > 0 ? follow->offset - 1 : 0;
+    size_t length = (size_t)(size - start);
+    char* text = (char*)malloc(length);
+    FILE* file = fopen(follow->csv_file, "rb");
+    bool ok = text != NULL && file != NULL && seek_file(file, start);
+    if (ok) length = fread(text, 1, length, file);
+    if (file != NULL) fclose(file);
+
+    const char* p = text;
+    const char* last_newline = NULL;
+    for (size_t i = ok ? length : 0; i > 0 && last_newline == NULL; i--) {
+        if (text[i - 1] == '\n') last_newline = text + i - 1;
+    }
+    if (last_newline != NULL && follow->offset > 0) {
+        if (*p != '\n') p = memchr(p, '\n', (size_t)(last_newline - p) + 1);
+        p++;
+    }
+    if (last_newline != NULL && p <= last_newline) {
+        ok = follow_append(p, last_newline + 1);
+        glutPostRedisplay();
+        post_scatter_redisplay();
+    }
+    if (last_newline != NULL) follow->offset = start + (uint64_t)(last_newline + 1 - text);
+    free(text);
+    if (!ok) {
+        fprintf(stderr, "Failed to read %s, no longer following it.\n", follow->csv_file);
+        return;
+    }
+    glutTimerFunc(FOLLOW_INTERVAL_MS, follow_poll, 0);
 }
 
-void draw_scatter_plot() {
-    if (closest_axis1 == -1 || closest_axis2 == -1) return; // Ensure axes are selected
+// Starts polling the input for appended rows, past the bytes the load parsed
+void start_following(LoadJob* job) {
+    int64_t mtime;
+    follow_state.csv_file = job->csv_file;
+    follow_state.offset = job->bytes_total;
+    if (follow_state.offset == 0 && !get_file_stamp(job->csv_file, &follow_state.offset, &mtime)) return;
+    glutTimerFunc(FOLLOW_INTERVAL_MS, follow_poll, 0);
+}
 
-    // Clear with white background
-    glClearColor(0.9375f, 0.9375f, 0.9375f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+// GUI side of a background load: shows new previews and progress, then the
+// final dataset. Previews are small enough for the scatter plot to build its
+// point arrays inline, so no scatter worker ever reads one being freed.
+void load_poll(int value) {
+    LoadJob* job = &load_job;
+    pthread_mutex_lock(&job->lock);
+    LoadPreview* preview = job->preview;
+    job->preview = NULL;
+    bool done = job->done;
+    load_fraction = job->bytes_total > 0 ? (float)job->bytes_done / job->bytes_total : 0.0f;
+    load_rows = job->rows_loaded;
+    pthread_mutex_unlock(&job->lock);
+
+    if (done) {
+        pthread_join(job->thread, NULL);
+        free_load_preview(preview);
+        if (!job->ok) exit(1);
+        finish_loading(job);
+        free_load_preview(shown_preview);
+        shown_preview = NULL;
+        prefetch_scatter_pairs();
+        start_splom_build(&splom_view, global_data);
+        if (following) start_following(job);
+    } else if (preview != NULL) {
+        set_global_dataset(preview->ds);
+        class_info = preview->classes;
+        num_classes = preview->num_classes;
+        density = preview->density;
+        free_load_preview(shown_preview);
+        shown_preview = preview;
+    }
 
-    // Set up orthographic projection for the scatter plot
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, 1, 0, 1); // Coordinate range [0, 1] for both x and y
+    glutSetWindow(parallel_coords_window);
+    glutPostRedisplay();
+    post_scatter_redisplay();
+    if (!done) glutTimerFunc(100, load_poll, 0);
+}
 
-    // Set modelview matrix
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+// Runs the load pipeline on a background thread while the GUI keeps drawing
+bool start_loading(LoadJob* job) {
+    job->progressive = true;
+    loading = pthread_create(&job->thread, NULL, load_pipeline, job) == 0;
+    if (!loading) {
+        fprintf(stderr, "Failed to start the loader thread.\n");
+        return false;
+    }
+    glutTimerFunc(100, load_poll, 0);
+    return true;
+}
 
-    // Draw axes
-    glColor3f(0.0f, 0.0f, 0.0f); // Black color for axes
-    glBegin(GL_LINES);
-        // X-axis
-        glVertex2f(0.001f, 0.001f); // Start at bottom left corner
-        glVertex2f(1.0f, 0.001f); // End at bottom right corner
-        // Y-axis
-        glVertex2f(0.001f, 0.001f); // Start at bottom left corner
-        glVertex2f(0.001f, 1.0f); // End at top left corner
-    glEnd();
+// Synthetic dataset shapes for --bench
+typedef enum { DIST_UNIFORM, DIST_NORMAL, DIST_CLUSTERED } Distribution;
 
-    // Label axes
-    char axis1_label[50], axis2_label[50];
-    sprintf(axis1_label, "Axis %d", closest_axis1 + 1);
-    sprintf(axis2_label, "Axis %d", closest_axis2 + 1);
-    renderBitmapString(0.01f, 0.48f, GLUT_BITMAP_HELVETICA_18, axis1_label); // X-axis label
-    renderBitmapString(0.48f, 0.01f, GLUT_BITMAP_HELVETICA_18, axis2_label);  // Y-axis label
+typedef struct {
+    long long* rows;        // Row counts to run, smallest first for scaling curves
+    int num_sizes;
+    int cols;               // Numeric columns, the class column comes on top
+    int classes;
+    Distribution distribution;
+    uint64_t seed;
+    int queries;            // Hover picks and box brushes timed per size
+    bool render;
+    const char* csv_path;   // Scratch file for the generated data
+    const char* out_path;   // JSON report
+} BenchConfig;
+
+uint64_t bench_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+double bench_uniform(uint64_t* state) {
+    return (bench_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
 
-    // Draw points for each row using data from the two closest axes
-    glBegin(GL_POINTS);
-    for (int row = 0; row < global_rows; row++) {
-        // Use color based on class
-        int class_index = (int)global_data[row][global_class_col_index];
-        glColor3f(class_info[class_index].r, class_info[class_index].g, class_info[class_index].b);
+double bench_normal(uint64_t* state) {
+    double u = bench_uniform(state), v = bench_uniform(state);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(6.283185307179586 * v);
+}
 
-        // Calculate x, y coordinates of the point based on the closest axes
-        float x = global_data[row][closest_axis1];
-        float y = global_data[row][closest_axis2];
-        glVertex2f(x, y); // Plot the point
+// Formats a value with four decimals, much faster than fprintf for large files
+char* bench_format(char* out, double value) {
+    if (value < 0) {
+        *out++ = '-';
+        value = -value;
     }
-    glEnd();
+    unsigned long long fixed = (unsigned long long)(value * 10000.0 + 0.5);
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + fixed % 10;
+        fixed /= 10;
+    } while (fixed > 0 || n < 5);
+    while (n > 4) *out++ = digits[--n];
+    *out++ = '.';
+    while (n > 0) *out++ = digits[--n];
+    return out;
+}
 
-    // Swap the buffers to display the scatter plot
-    glutSwapBuffers();
+bool generate_csv(const char* path, long long rows, BenchConfig* config) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Error opening benchmark CSV");
+        return false;
+    }
+    for (int col = 0; col < config->cols; col++) fprintf(file, "x%d,", col + 1);
+    fprintf(file, "class\n");
+
+    // Clustered data gives every class its own center on every column
+    uint64_t state = config->seed ? config->seed : 1;
+    double* centers = (double*)malloc((size_t)config->classes * config->cols * sizeof(double));
+    char* line = (char*)malloc((size_t)config->cols * 32 + 32);
+    if (centers == NULL || line == NULL) {
+        perror("Memory allocation failed for benchmark data");
+        free(centers);
+        free(line);
+        fclose(file);
+        return false;
+    }
+    for (int i = 0; i < config->classes * config->cols; i++) centers[i] = bench_uniform(&state) * 100.0;
+
+    bool ok = true;
+    for (long long row = 0; row < rows && ok; row++) {
+        int class_index = (int)(bench_random(&state) % config->classes);
+        char* p = line;
+        for (int col = 0; col < config->cols; col++) {
+            double value;
+            switch (config->distribution) {
+                case DIST_NORMAL: value = 50.0 + 15.0 * bench_normal(&state); break;
+                case DIST_CLUSTERED: value = centers[class_index * config->cols + col] + 5.0 * bench_normal(&state); break;
+                default: value = bench_uniform(&state) * 100.0; break;
+            }
+            p = bench_format(p, value);
+            *p++ = ',';
+        }
+        p += sprintf(p, "c%d\n", class_index);
+        ok = fwrite(line, 1, p - line, file) == (size_t)(p - line);
+    }
+    free(centers);
+    free(line);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Failed to write %s.\n", path);
+    return ok;
 }
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        printf("Usage: %s <csv_file>\n", argv[0]);
-        return 1;
+// Writes "name": {"mean": , "p50": , "p99": } for samples in the given unit
+void write_latency_json(FILE* out, const char* name, double* samples, int count, double unit) {
+    if (count == 0) {
+        fprintf(out, "      \"%s\": null", name);
+        return;
+    }
+    double sum = 0;
+    for (int i = 0; i < count; i++) sum += samples[i];
+    qsort(samples, count, sizeof(double), compare_doubles);
+    fprintf(out, "      \"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f}", name,
+            sum / count * unit, samples[count / 2] * unit, samples[(int)((count - 1) * 0.99)] * unit);
+}
+
+// Frees a benchmarked dataset with its densities, index and classes, and
+// clears the globals pointing at them
+void bench_release(Dataset* ds) {
+    free_pick_index(&pick_index);
+    pick_index.dirty = true;
+    free_selection(&box_selection);
+    free(density);
+    density = NULL;
+    free(density_levels);
+    density_levels = NULL;
+    dataset_free(ds);
+    global_data = NULL;
+    class_dict_free(&class_dict);
+}
+
+// Times one dataset size through every stage and appends its JSON object
+bool bench_size(FILE* out, long long rows, BenchConfig* config, bool render) {
+    double start_time = get_time_seconds();
+    if (!generate_csv(config->csv_path, rows, config)) return false;
+    double generate_time = get_time_seconds() - start_time;
+
+    start_time = get_time_seconds();
+    Dataset* ds = load_csv(config->csv_path, &class_dict, NULL, NULL);
+    double load_time = get_time_seconds() - start_time;
+    remove(config->csv_path);
+    if (ds == NULL) return false;
+    set_global_dataset(ds);
+
+    float min_vals[ds->cols], max_vals[ds->cols];
+    start_time = get_time_seconds();
+    normalize_data(ds, min_vals, max_vals);
+    double normalize_time = get_time_seconds() - start_time;
+    start_time = get_time_seconds();
+    if (compact_mode && !compact_dataset(ds)) {
+        bench_release(ds);
+        return false;
     }
+    double compact_time = get_time_seconds() - start_time;
 
-    // Initialize GLUT
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    if (compact_mode) {
+        density_levels = (uint8_t*)malloc((size_t)ds->rows * ds->cols + 1);
+    } else {
+        density = (float*)malloc((size_t)ds->rows * ds->cols * sizeof(float));
+    }
+    double* samples = (double*)malloc(config->queries * sizeof(double));
+    if ((density == NULL && density_levels == NULL) || samples == NULL) {
+        perror("Memory allocation failed for benchmark");
+        free(samples);
+        bench_release(ds);
+        return false;
+    }
+    start_time = get_time_seconds();
+    build_sorted_index(ds);
+    double sort_time = get_time_seconds() - start_time;
+    start_time = get_time_seconds();
+    if (compact_mode) calculate_density_levels(ds, density_levels); else calculate_density(ds, density);
+    double density_time = get_time_seconds() - start_time;
+
+    fprintf(out, "    {\n      \"rows\": %d,\n      \"classes\": %d,\n", ds->rows, num_classes);
+    fprintf(out, "      \"generate_s\": %.6f,\n      \"load_csv_s\": %.6f,\n      \"load_rows_per_s\": %.0f,\n",
+            generate_time, load_time, ds->rows / (load_time > 0 ? load_time : 1e-9));
+    fprintf(out, "      \"normalize_s\": %.6f,\n      \"compact_s\": %.6f,\n      \"sort_index_s\": %.6f,\n      \"density_s\": %.6f,\n",
+            normalize_time, compact_time, sort_time, density_time);
+
+    // Hover picking, the same path as mouse_motion, at random cursor positions
+    uint64_t state = config->seed + 0x9E3779B97F4A7C15ull;
+    start_time = get_time_seconds();
+    build_pick_index(&pick_index);
+    fprintf(out, "      \"pick_index_s\": %.6f,\n", get_time_seconds() - start_time);
+    for (int i = 0; i < config->queries; i++) {
+        float wx = (float)bench_uniform(&state), wy = (float)bench_uniform(&state);
+        start_time = get_time_seconds();
+        update_hover(wx, wy);
+        samples[i] = get_time_seconds() - start_time;
+    }
+    write_latency_json(out, "pick_us", samples, config->queries, 1e6);
+    fprintf(out, ",\n");
+
+    // Box brushes of random position and size
+    for (int i = 0; i < config->queries; i++) {
+        float x0 = (float)bench_uniform(&state), y0 = (float)bench_uniform(&state);
+        float x1 = x0 + 0.2f * (float)bench_uniform(&state), y1 = y0 + 0.2f * (float)bench_uniform(&state);
+        start_time = get_time_seconds();
+        brush_box(ds, x0, y0, x1, y1, &box_selection);
+        samples[i] = get_time_seconds() - start_time;
+    }
+    write_latency_json(out, "brush_ms", samples, config->queries, 1e3);
+
+    // Frames of both renderers, after their one-off geometry builds
+    if (render) {
+        int frames = 3;
+        hovered_row = -1;
+        start_time = get_time_seconds();
+        build_polyline_buffers(&pc_buffers, ds, class_info, density);
+        fprintf(out, ",\n      \"polyline_buffers_s\": %.6f,\n", get_time_seconds() - start_time);
+        aggregate_mode = false;
+        for (int i = 0; i < frames; i++) {
+            static_layer.dirty = true;
+            start_time = get_time_seconds();
+            display();
+            samples[i] = get_time_seconds() - start_time;
+        }
+        write_latency_json(out, "frame_ms", samples, frames, 1e3);
+
+        // Hover frames only composite the static layer and draw the highlight
+        fprintf(out, ",\n");
+        for (int i = 0; i < config->queries; i++) {
+            hovered_row = ds->rows > 0 ? (int)(bench_random(&state) % ds->rows) : -1;
+            start_time = get_time_seconds();
+            display();
+            samples[i] = get_time_seconds() - start_time;
+        }
+        hovered_row = -1;
+        write_latency_json(out, "hover_frame_ms", samples, config->queries, 1e3);
+        free_polyline_buffers(&pc_buffers);
+        pc_buffers.dirty = true;
+
+        aggregate_mode = true;
+        start_time = get_time_seconds();
+        update_aggregate_view(&aggregate_view, ds, num_classes);
+        build_aggregate_bands(&aggregate_view, ds, class_info);
+        fprintf(out, ",\n      \"aggregate_build_s\": %.6f,\n", get_time_seconds() - start_time);
+        for (int i = 0; i < frames; i++) {
+            static_layer.dirty = true;
+            start_time = get_time_seconds();
+            display();
+            samples[i] = get_time_seconds() - start_time;
+        }
+        write_latency_json(out, "aggregate_frame_ms", samples, frames, 1e3);
+        free_aggregate_view(&aggregate_view);
+        aggregate_mode = false;
+    }
+    fprintf(out, "\n    }");
 
-    // Create main window for parallel coordinates
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Parallel Coordinates");
-    parallel_coords_window = glutGetWindow(); // Store the window ID
-    init(); // Initialize OpenGL state for the main window
+    free(samples);
+    bench_release(ds);
+    return true;
+}
 
-    glutDisplayFunc(display); // Set display callback for main window
-    glutKeyboardFunc(keyboard); // Set keyboard callback for main window
-    glutMouseFunc(mouse); // Set mouse callback for main window
-    glutPassiveMotionFunc(mouse_motion); // Set mouse motion callback for main window
+// Runs the benchmark over every configured size and writes the JSON report
+bool run_benchmark(BenchConfig* config) {
+    FILE* out = fopen(config->out_path, "w");
+    if (out == NULL) {
+        perror("Error opening benchmark report");
+        return false;
+    }
+    const char* distributions[] = { "uniform", "normal", "clustered" };
+    fprintf(out, "{\n  \"compact\": %s,\n  \"threads\": %d,\n  \"cols\": %d,\n  \"classes\": %d,\n  \"distribution\": \"%s\",\n  \"seed\": %llu,\n",
+            compact_mode ? "true" : "false", num_threads, config->cols, config->classes, distributions[config->distribution], (unsigned long long)config->seed);
+
+    bool have_context = config->render && create_offscreen_context(headless_width, headless_height);
+    if (have_context) init();
+    fprintf(out, "  \"render\": %s,\n  \"width\": %d,\n  \"height\": %d,\n  \"sizes\": [\n",
+            have_context ? "true" : "false", headless_width, headless_height);
+
+    bool ok = true;
+    for (int i = 0; i < config->num_sizes && ok; i++) {
+        printf("Benchmarking %lld rows\n", config->rows[i]);
+        if (i > 0) fprintf(out, ",\n");
+        ok = bench_size(out, config->rows[i], config, have_context);
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (have_context) destroy_offscreen_context();
+    if (fclose(out) != 0) ok = false;
+    if (ok) printf("Wrote %s\n", config->out_path);
+    return ok;
+}
 
-    // Create scatter plot window
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Scatter Plot");
-    scatter_plot_window = glutGetWindow(); // Get the window ID
-    initScatterPlot(); // Initialize OpenGL state for scatter plot window
-    glutDisplayFunc(draw_scatter_plot); // Set display callback
-    
-    // Load CSV data
-    global_data = load_csv(argv[1], &global_rows, &global_cols, &global_class_col_index, &class_info, &num_classes);
-    axis_inverted = (bool*)calloc(global_cols, sizeof(bool));
-    if (global_data == NULL) {
-        fprintf(stderr, "Failed to load data.\n");
+int main(int argc, char** argv) {
+    const char* csv_file = NULL;
+    const char* render_file = NULL;
+    bool use_cache = true;
+    long long bench_rows[32] = { 10000, 100000, 1000000 };
+    BenchConfig bench = { bench_rows, 3, 8, 5, DIST_UNIFORM, 1, 200, true, "cvis_bench.csv", "cvis_bench.json" };
+    bool bench_mode = false;
+    num_threads = get_cpu_count();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) num_threads = 1;
+        } else if (strcmp(argv[i], "--aggregate") == 0) {
+            aggregate_mode = true;
+        } else if (strcmp(argv[i], "--normalize") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "zscore") == 0) normalization = NORMALIZE_ZSCORE;
+            else if (strcmp(argv[i], "global") == 0) normalization = NORMALIZE_GLOBAL;
+            else normalization = NORMALIZE_MINMAX;
+        } else if (strcmp(argv[i], "--splom") == 0) {
+            splom_mode = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (!open_trace(argv[++i])) return 1;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            compact_mode = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = false;
+        } else if (strcmp(argv[i], "--out-of-core") == 0) {
+            out_of_core = true;
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memory_budget = (size_t)strtoull(argv[++i], NULL, 10) << 20;
+        } else if (strcmp(argv[i], "--follow") == 0) {
+            following = true;
+        } else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            render_file = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &headless_width, &headless_height) != 2 || headless_width < 1 || headless_height < 1) {
+                fprintf(stderr, "Invalid --size %s, expected WIDTHxHEIGHT.\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench_mode = true;
+            headless = true;
+        } else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            // Comma separated list, e.g. 10000,1000000,100000000
+            char* p = argv[++i];
+            bench.num_sizes = 0;
+            while (*p != '\0' && bench.num_sizes < 32) {
+                bench_rows[bench.num_sizes++] = strtoll(p, &p, 10);
+                if (*p == ',') p++; else break;
+            }
+        } else if (strcmp(argv[i], "--cols") == 0 && i + 1 < argc) {
+            bench.cols = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--classes") == 0 && i + 1 < argc) {
+            bench.classes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dist") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "normal") == 0) bench.distribution = DIST_NORMAL;
+            else if (strcmp(argv[i], "clustered") == 0) bench.distribution = DIST_CLUSTERED;
+            else bench.distribution = DIST_UNIFORM;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            bench.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            bench.queries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-render") == 0) {
+            bench.render = false;
+        } else if (strcmp(argv[i], "--bench-csv") == 0 && i + 1 < argc) {
+            bench.csv_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            bench.out_path = argv[++i];
+        } else if (argv[i][0] != '-' && csv_file == NULL) {
+            csv_file = argv[i];
+        }
+    }
+    if (bench_mode) {
+        if (bench.cols < 2 || bench.classes < 1 || bench.queries < 3 || bench.num_sizes == 0) {
+            fprintf(stderr, "The benchmark needs at least 2 columns, 1 class, 3 queries and one row count.\n");
+            return 1;
+        }
+        return run_benchmark(&bench) ? 0 : 1;
+    }
+    if (csv_file == NULL) {
+        printf("Usage: %s [--threads N] [--normalize minmax|zscore|global] [--aggregate] [--splom] [--trace out.csv|out.json] [--compact] [--no-cache] [--out-of-core [--memory-budget MB]] [--follow] [--render out.png|out.ppm [--size WxH]] <csv_file>\n"
+               "       %s --bench [--rows N,N,...] [--cols C] [--classes K] [--dist uniform|normal|clustered]\n"
+               "              [--seed S] [--queries Q] [--no-render] [--bench-csv FILE] [--bench-out FILE]\n", argv[0], argv[0]);
         return 1;
     }
-   
-    // Normalize data
-    float min_vals[global_cols], max_vals[global_cols];
-    normalize_data(global_data, global_rows, global_cols, min_vals, max_vals);
-    
-    density = (float*)malloc(global_rows * global_cols * sizeof(float));
-    if (!density) {
-        fprintf(stderr, "Failed to allocate memory for density.\n");
-        // Handle the error, such as exiting the program
+    if (following && (compact_mode || headless)) {
+        fprintf(stderr, "--follow needs the interactive view and cannot be combined with --compact or --render.\n");
+        return 1;
+    }
+    if (following) use_cache = false; // The cache would go stale with the first appended row
+    if (out_of_core && (compact_mode || following)) {
+        fprintf(stderr, "--out-of-core cannot be combined with --compact or --follow.\n");
+        return 1;
     }
-    calculate_density(global_data, global_rows, global_cols, density);
 
+    // Initialize GLUT, unless rendering offscreen
+    if (!headless) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+
+        // Create main window for parallel coordinates
+        glutInitWindowSize(800, 600);
+        glutCreateWindow("Parallel Coordinates");
+        parallel_coords_window = glutGetWindow(); // Store the window ID
+        init(); // Initialize OpenGL state for the main window
+
+        glutDisplayFunc(display); // Set display callback for main window
+        glutKeyboardFunc(keyboard); // Set keyboard callback for main window
+        glutMouseFunc(mouse); // Set mouse callback for main window
+        glutPassiveMotionFunc(mouse_motion); // Set mouse motion callback for main window
+        glutMotionFunc(brush_motion); // Dragging with a button held moves the brush
+
+        // Create scatter plot window
+        glutInitWindowSize(800, 600);
+        glutCreateWindow("Scatter Plot");
+        scatter_plot_window = glutGetWindow(); // Get the window ID
+        initScatterPlot(); // Initialize OpenGL state for scatter plot window
+        glutDisplayFunc(draw_scatter_plot); // Set display callback
+    }
+    
+    // Offscreen renders load up front; the GUI loads in the background and
+    // draws previews of the rows parsed so far in the meantime
+    load_job.csv_file = csv_file;
+    load_job.use_cache = use_cache;
+    if (headless) {
+        if (!load_dataset(&load_job)) return 1;
+        finish_loading(&load_job);
+        if (splom_mode) start_splom_build(&splom_view, global_data);
+        bool ok = render_offscreen(render_file);
+        free(axis_inverted);
+        free(load_job.min_vals);
+        free(load_job.max_vals);
+        class_dict_free(&class_dict);
+        if (!density_in_cache) free(density);
+        free(density_levels);
+        dataset_free(global_data);
+        return ok ? 0 : 1;
+    }
     
+    if (!start_loading(&load_job)) return 1;
+
     // Start the GLUT main loop
     glutMainLoop();
 
     // Free resources
     free(axis_inverted);
-    for (int i = 0; i < num_classes; i++) {
-        free(class_info[i].class_name);
-    }
-    free(class_info);
-    for (int i = 0; i < global_rows; i++) {
-        free(global_data[i]);
-    }
-    free(global_data);
-    free(density);
+    free(load_job.min_vals);
+    free(load_job.max_vals);
+    free_aggregate_view(&aggregate_view);
+    class_dict_free(&class_dict);
+    if (!density_in_cache) free(density);
+    free(density_levels);
+    free(sample_order);
+    for (int b = 0; b < MAX_BRUSHES; b++) free_selection(&brushes[b].rows);
+    free_selection(&box_selection);
+    free(focus_batch.indices);
+    dataset_free(global_data);
     return 0;
 }
@@ -1,6 +1,10 @@
 CC = gcc
 CFLAGS = -Wall -o
-LIBS = -lfreeglut -lopengl32 -lglu32
+ifeq ($(OS),Windows_NT)
+LIBS = -lfreeglut -lopengl32 -lglu32 -lpthread
+else
+LIBS = -lglut -lGL -lGLU -lEGL -lm -lpthread
+endif
 
 SRC = CVis.c
 
@@ -8,8 +12,14 @@ OUTPUT = CVis
 
 all: $(OUTPUT)
 
+.PHONY: all bench clean
+
 $(OUTPUT): $(SRC)
 	$(CC) $(CFLAGS) $@ $< $(LIBS)
 
+# Writes cvis_bench.json; pass e.g. BENCH_ARGS="--rows 10000,1000000,100000000"
+bench: $(OUTPUT)
+	./$(OUTPUT) --bench $(BENCH_ARGS)
+
 clean:
-	rm -f $(OUTPUT)
+	rm -f $(OUTPUT) cvis_bench.json